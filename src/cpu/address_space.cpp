@@ -1,13 +1,22 @@
 #include "address_space.h"
+#include "bus_profiler.h"
 
+#include <algorithm>
+#include <iterator>
 #include <halley.hpp>
 using namespace Halley;
 
 AddressSpace8BitBy16Bit::AddressSpace8BitBy16Bit()
 	: memory{fallbackPage}
+	, sources{fallbackPage}
 	, masks{0xFF}
+	, pageFlags{0}
 	, fallbackPage{0}
+	, pageVersions{0}
 {
+#ifdef EMUND_DIRTY_PAGES
+	std::fill(std::begin(dirtyPages), std::end(dirtyPages), uint8_t(1));
+#endif
 }
 
 void AddressSpace8BitBy16Bit::map(gsl::span<uint8_t> memoryToMap, uint16_t startAddress, uint16_t endAddress, uint8_t mask)
@@ -23,7 +32,7 @@ void AddressSpace8BitBy16Bit::map(gsl::span<uint8_t> memoryToMap, uint16_t start
 
 	for (size_t pageI = 0; pageI < dstPages; ++pageI) {
 		const auto page = pageI + (startAddress / pageSize);
-		memory[page] = memoryToMap.data() + ((pageI % srcPages) * pageSize);
+		setPageMemory(uint8_t(page), memoryToMap.data() + ((pageI % srcPages) * pageSize));
 		masks[page] = mask;
 	}
 }
@@ -37,26 +46,282 @@ void AddressSpace8BitBy16Bit::unmap(uint16_t startAddress, uint16_t endAddress)
 	const size_t len = size_t(endAddress) - startAddress + 1;
 
 	for (size_t pageI = 0; pageI < (len / pageSize); ++pageI) {
-		memory[pageI + (startAddress / pageSize)] = fallbackPage;
+		setPageMemory(uint8_t(pageI + (startAddress / pageSize)), fallbackPage);
 	}
 }
 
-void AddressSpace8BitBy16Bit::mapRegister(uint16_t startAddress, uint16_t endAddress, void* data, RegisterCallback callback)
+void AddressSpace8BitBy16Bit::setPageMemory(uint8_t page, uint8_t* source)
 {
-	for (auto& r: registers) {
-		if (!r.callback) {
-			r.data = data;
-			r.callback = callback;
-			r.startAddress = startAddress;
-			r.endAddress = endAddress;
+	sources[page] = source;
+	memory[page] = (pageFlags[page] & PagePatched) && pagePatcher ? pagePatcher(pagePatcherContext, page, source) : source;
+	pageFlags[page] &= ~PageWatched;
+}
+
+void AddressSpace8BitBy16Bit::setPagePatcher(void* context, PagePatcher patcher)
+{
+	pagePatcherContext = context;
+	pagePatcher = patcher;
+}
+
+void AddressSpace8BitBy16Bit::setPagePatched(uint8_t page, bool patched)
+{
+	if (patched) {
+		pageFlags[page] |= PagePatched;
+	} else {
+		pageFlags[page] &= ~PagePatched;
+	}
+	setPageMemory(page, sources[page]);
+
+	// Patching changes what the page holds without necessarily changing where it points (a new copy can land where
+	// the last one was freed), so anything decoded from it has to go
+	++pageVersions[page];
+}
+
+void AddressSpace8BitBy16Bit::mapReadRegister(uint16_t startAddress, uint16_t endAddress, void* context, ReadHandler handler)
+{
+	Expects(startAddress <= endAddress);
+
+	for (size_t page = startAddress >> 8; page <= size_t(endAddress >> 8); ++page) {
+		const uint8_t first = page == size_t(startAddress >> 8) ? uint8_t(startAddress & 0xFF) : 0x00;
+		const uint8_t last = page == size_t(endAddress >> 8) ? uint8_t(endAddress & 0xFF) : 0xFF;
+		auto& registers = readRegisters[page];
+		registers.insert(registers.begin(), ReadRegister{ first, last, handler, context });
+		updateRegisterFlags(uint8_t(page));
+	}
+}
+
+void AddressSpace8BitBy16Bit::mapWriteRegister(uint16_t startAddress, uint16_t endAddress, void* context, WriteHandler handler)
+{
+	Expects(startAddress <= endAddress);
+
+	for (size_t page = startAddress >> 8; page <= size_t(endAddress >> 8); ++page) {
+		const uint8_t first = page == size_t(startAddress >> 8) ? uint8_t(startAddress & 0xFF) : 0x00;
+		const uint8_t last = page == size_t(endAddress >> 8) ? uint8_t(endAddress & 0xFF) : 0xFF;
+		auto& registers = writeRegisters[page];
+		registers.insert(registers.begin(), WriteRegister{ first, last, handler, context });
+		updateRegisterFlags(uint8_t(page));
+	}
+}
+
+void AddressSpace8BitBy16Bit::unmapRegisters(uint16_t startAddress, uint16_t endAddress)
+{
+	Expects(startAddress % pageSize == 0);
+	Expects(endAddress % pageSize == pageSize - 1);
+
+	for (size_t page = startAddress >> 8; page <= size_t(endAddress >> 8); ++page) {
+		readRegisters[page].clear();
+		writeRegisters[page].clear();
+		updateRegisterFlags(uint8_t(page));
+	}
+}
+
+void AddressSpace8BitBy16Bit::updateRegisterFlags(uint8_t page)
+{
+	pageFlags[page] &= ~(PageReadRegisters | PageWriteRegisters);
+	if (!readRegisters[page].empty()) {
+		pageFlags[page] |= PageReadRegisters;
+	}
+	if (!writeRegisters[page].empty()) {
+		pageFlags[page] |= PageWriteRegisters;
+	}
+}
+
+void AddressSpace8BitBy16Bit::setBreakpointHandler(void* context, BreakpointHandler handler)
+{
+	breakpointContext = context;
+	breakpointHandler = handler;
+}
+
+void AddressSpace8BitBy16Bit::addReadBreakpoint(uint16_t startAddress, uint16_t endAddress)
+{
+	addBreakpoint(readBreakpoints, PageReadBreakpoints, startAddress, endAddress);
+}
+
+void AddressSpace8BitBy16Bit::addWriteBreakpoint(uint16_t startAddress, uint16_t endAddress)
+{
+	addBreakpoint(writeBreakpoints, PageWriteBreakpoints, startAddress, endAddress);
+}
+
+void AddressSpace8BitBy16Bit::addBreakpoint(std::array<std::vector<Breakpoint>, numPages>& breakpoints, PageFlags flag, uint16_t startAddress, uint16_t endAddress)
+{
+	Expects(startAddress <= endAddress);
 
-			registersStartAddress = std::min(registersStartAddress, startAddress);
-			registersEndAddress = std::max(registersEndAddress, endAddress);
-			return;
+	for (size_t page = startAddress >> 8; page <= size_t(endAddress >> 8); ++page) {
+		const uint8_t first = page == size_t(startAddress >> 8) ? uint8_t(startAddress & 0xFF) : 0x00;
+		const uint8_t last = page == size_t(endAddress >> 8) ? uint8_t(endAddress & 0xFF) : 0xFF;
+		breakpoints[page].push_back(Breakpoint{ first, last });
+		pageFlags[page] |= flag;
+	}
+	++nBreakpoints;
+}
+
+void AddressSpace8BitBy16Bit::clearBreakpoints()
+{
+	for (size_t page = 0; page < numPages; ++page) {
+		readBreakpoints[page].clear();
+		writeBreakpoints[page].clear();
+		pageFlags[page] &= ~(PageReadBreakpoints | PageWriteBreakpoints);
+	}
+	nBreakpoints = 0;
+}
+
+bool AddressSpace8BitBy16Bit::hasBreakpoints() const
+{
+	return nBreakpoints > 0;
+}
+
+void AddressSpace8BitBy16Bit::setProfiler(BusProfiler* profiler)
+{
+	this->profiler = profiler;
+}
+
+BusProfiler* AddressSpace8BitBy16Bit::getProfiler() const
+{
+	return profiler;
+}
+
+bool AddressSpace8BitBy16Bit::isInstrumented() const
+{
+	return nBreakpoints > 0 || profiler != nullptr;
+}
+
+void AddressSpace8BitBy16Bit::profileRead(uint16_t address) const
+{
+	profiler->recordRead(address);
+}
+
+void AddressSpace8BitBy16Bit::profileWrite(uint16_t address) const
+{
+	profiler->recordWrite(address);
+}
+
+bool AddressSpace8BitBy16Bit::isInRange(const std::vector<Breakpoint>& breakpoints, uint8_t offset)
+{
+	for (const auto& b: breakpoints) {
+		if (offset >= b.first && offset <= b.last) {
+			return true;
+		}
+	}
+	return false;
+}
+
+uint8_t AddressSpace8BitBy16Bit::readSlow(uint16_t address) const
+{
+	const auto page = address >> 8;
+	const auto offset = uint8_t(address & 0xFF);
+	const auto value = [&] () -> uint8_t
+	{
+		for (const auto& r: readRegisters[page]) {
+			if (offset >= r.first && offset <= r.last) {
+#ifdef EMUND_BUS_PROFILING
+				if (profiler) {
+					profiler->recordRegisterAccess(reinterpret_cast<const void*>(r.handler), address, false);
+				}
+#endif
+				return r.handler(r.context, address);
+			}
+		}
+		return memory[page][address & masks[page]];
+	}();
+
+	if ((pageFlags[page] & PageReadBreakpoints) && breakpointHandler && isInRange(readBreakpoints[page], offset)) {
+		breakpointHandler(breakpointContext, address, value, false);
+	}
+	return value;
+}
+
+void AddressSpace8BitBy16Bit::writeSlow(uint16_t address, uint8_t value)
+{
+	const auto page = address >> 8;
+	const auto offset = uint8_t(address & 0xFF);
+	if ((pageFlags[page] & PageWriteBreakpoints) && breakpointHandler && isInRange(writeBreakpoints[page], offset)) {
+		breakpointHandler(breakpointContext, address, value, true);
+	}
+
+	if (pageFlags[page] & PageWriteRegisters) {
+		for (const auto& r: writeRegisters[page]) {
+			if (offset >= r.first && offset <= r.last) {
+#ifdef EMUND_BUS_PROFILING
+				if (profiler) {
+					profiler->recordRegisterAccess(reinterpret_cast<const void*>(r.handler), address, true);
+				}
+#endif
+				r.handler(r.context, address, value);
+				return;
+			}
 		}
 	}
 
-	// All slots allocated
+	memory[page][address & masks[page]] = value;
+	markPageDirty(uint8_t(page));
+	if (pageFlags[page] & PageWatched) {
+		onWatchedPageWrite(page);
+	}
+}
+
+bool AddressSpace8BitBy16Bit::isPlainMemory(uint8_t page) const
+{
+	return (pageFlags[page] & (PageReadRegisters | PageWriteRegisters | PageReadBreakpoints | PageWriteBreakpoints)) == 0;
+}
+
+bool AddressSpace8BitBy16Bit::isPlainReadMemory(uint8_t page) const
+{
+	return (pageFlags[page] & (PageReadRegisters | PageReadBreakpoints)) == 0;
+}
+
+void AddressSpace8BitBy16Bit::watchWrites(uint8_t page)
+{
+	// Mirrors of the same memory need to be watched too, or writes through them would go unnoticed
+	for (size_t i = 0; i < numPages; ++i) {
+		if (memory[i] == memory[page]) {
+			pageFlags[i] |= PageWatched;
+		}
+	}
+}
+
+void AddressSpace8BitBy16Bit::onWatchedPageWrite(uint8_t page)
+{
+	for (size_t i = 0; i < numPages; ++i) {
+		if (memory[i] == memory[page]) {
+			++pageVersions[i];
+		}
+	}
+}
+
+bool AddressSpace8BitBy16Bit::isPageDirty([[maybe_unused]] uint8_t page) const
+{
+#ifdef EMUND_DIRTY_PAGES
+	return dirtyPages[page] != 0;
+#else
+	return true;
+#endif
+}
+
+AddressSpace8BitBy16Bit::PageSet AddressSpace8BitBy16Bit::getDirtyPages() const
+{
+	PageSet result;
+#ifdef EMUND_DIRTY_PAGES
+	for (size_t i = 0; i < numPages; ++i) {
+		result[i] = dirtyPages[i] != 0;
+	}
+#else
+	result.set();
+#endif
+	return result;
+}
+
+void AddressSpace8BitBy16Bit::clearDirtyPages()
+{
+#ifdef EMUND_DIRTY_PAGES
+	std::fill(std::begin(dirtyPages), std::end(dirtyPages), uint8_t(0));
+#endif
+}
+
+AddressSpace8BitBy16Bit::PageSet AddressSpace8BitBy16Bit::takeDirtyPages()
+{
+	auto result = getDirtyPages();
+	clearDirtyPages();
+	return result;
 }
 
 void AddressSpace8BitBy16Bit::dump(uint16_t startAddress, uint16_t endAddress)
@@ -1,29 +1,41 @@
 #pragma once
 
+#include <array>
+#include <bitset>
 #include <cstdint>
 #include <vector>
 #include <gsl/span>
 #include "../utils/macros.h"
 
+class BusProfiler;
+
 class AddressSpace8BitBy16Bit {
+	friend class CPU6502JIT;
+
 public:
-	using RegisterCallback = void(*)(void*, uint16_t, uint8_t&, bool);
+	constexpr static size_t pageSize = 256;
+	constexpr static size_t numPages = 256;
+
+	using ReadHandler = uint8_t(*)(void* context, uint16_t address);
+	using WriteHandler = void(*)(void* context, uint16_t address, uint8_t value);
+	using BreakpointHandler = void(*)(void* context, uint16_t address, uint8_t value, bool write);
+	using PagePatcher = uint8_t*(*)(void* context, uint8_t page, uint8_t* source);
+	using PageSet = std::bitset<numPages>;
 
 	AddressSpace8BitBy16Bit();
 	
 	FORCEINLINE uint8_t read(uint16_t address) const
 	{
-		if (address >= registersStartAddress && address <= registersEndAddress) {
-			for (auto& r: registers) {
-				if (address >= r.startAddress && address <= r.endAddress) {
-					uint8_t value = 0;
-					r.callback(r.data, address, value, false);
-					return value;
-				}
-			}
+		const auto page = address >> 8;
+#ifdef EMUND_BUS_PROFILING
+		if (profiler) {
+			profileRead(address);
+		}
+#endif
+		if (pageFlags[page] & (PageReadRegisters | PageReadBreakpoints)) {
+			return readSlow(address);
 		}
-		
-		return readDirect(address);
+		return memory[page][address & masks[page]];
 	}
 
 	FORCEINLINE uint8_t readDirect(uint16_t address) const
@@ -33,44 +45,166 @@ public:
 		return page[address & mask];
 	}
 	
-	FORCEINLINE void write(uint16_t address, uint8_t value) const
+	FORCEINLINE void write(uint16_t address, uint8_t value)
 	{
-		if (address >= registersStartAddress && address <= registersEndAddress) {
-			for (auto& r: registers) {
-				if (address >= r.startAddress && address <= r.endAddress) {
-					r.callback(r.data, address, value, true);
-					return;
-				}
-			}
+		const auto page = address >> 8;
+#ifdef EMUND_BUS_PROFILING
+		if (profiler) {
+			profileWrite(address);
 		}
+#endif
+		if (pageFlags[page] & (PageWriteRegisters | PageWriteBreakpoints | PageWatched)) {
+			writeSlow(address, value);
+			return;
+		}
+		memory[page][address & masks[page]] = value;
+		markPageDirty(uint8_t(page));
+	}
 
-		const auto& page = memory[address >> 8];
-		const auto mask = masks[address >> 8];
-		page[address & mask] = value;
+	// For anything writing to mapped memory without going through write()
+	FORCEINLINE void markPageDirty([[maybe_unused]] uint8_t page)
+	{
+#ifdef EMUND_DIRTY_PAGES
+		dirtyPages[page] = 1;
+#endif
+	}
+
+	FORCEINLINE const uint8_t* getPage(uint8_t page) const
+	{
+		return memory[page];
+	}
+
+	FORCEINLINE uint8_t getPageMask(uint8_t page) const
+	{
+		return masks[page];
+	}
+
+	FORCEINLINE uint32_t getPageVersion(uint8_t page) const
+	{
+		return pageVersions[page];
 	}
 
 	void map(gsl::span<uint8_t> memory, uint16_t startAddress, uint16_t endAddress, uint8_t mask = 0xFF);
 	void unmap(uint16_t startAddress, uint16_t endAddress);
 
-	void mapRegister(uint16_t startAddress, uint16_t endAddress, void* data, RegisterCallback callback);
+	// Accesses in the range go to the handler instead of memory. Ranges mapped later take precedence over earlier ones.
+	void mapReadRegister(uint16_t startAddress, uint16_t endAddress, void* context, ReadHandler handler);
+	void mapWriteRegister(uint16_t startAddress, uint16_t endAddress, void* context, WriteHandler handler);
+	void unmapRegisters(uint16_t startAddress, uint16_t endAddress);
+
+	// Typed versions, calling a member function of context, e.g. mapReadRegister<&Foo::readBar>(0x4000, 0x4000, foo)
+	template <auto handler, typename T>
+	void mapReadRegister(uint16_t startAddress, uint16_t endAddress, T& context)
+	{
+		mapReadRegister(startAddress, endAddress, &context, [] (void* self, uint16_t address) -> uint8_t
+		{
+			return (static_cast<T*>(self)->*handler)(address);
+		});
+	}
+
+	template <auto handler, typename T>
+	void mapWriteRegister(uint16_t startAddress, uint16_t endAddress, T& context)
+	{
+		mapWriteRegister(startAddress, endAddress, &context, [] (void* self, uint16_t address, uint8_t value)
+		{
+			(static_cast<T*>(self)->*handler)(address, value);
+		});
+	}
+
+	// Patched pages get whatever the patcher returns mapped in place of the memory they'd normally map, e.g. a copy of
+	// it with a few bytes changed. It's consulted whenever they get (re)mapped, so it costs nothing to reads.
+	void setPagePatcher(void* context, PagePatcher patcher);
+	void setPagePatched(uint8_t page, bool patched);
+
+	// Accesses in the range call the breakpoint handler: reads after the value is read, writes before it's written.
+	// Only pages with a breakpoint leave the fast path.
+	void setBreakpointHandler(void* context, BreakpointHandler handler);
+	void addReadBreakpoint(uint16_t startAddress, uint16_t endAddress);
+	void addWriteBreakpoint(uint16_t startAddress, uint16_t endAddress);
+	void clearBreakpoints();
+	bool hasBreakpoints() const;
+
+	// Counts every access that goes through read() and write(). Only does anything with EMUND_BUS_PROFILING.
+	void setProfiler(BusProfiler* profiler);
+	BusProfiler* getProfiler() const;
+
+	// Whether anything needs to see every single access, so callers mustn't go around read() and write()
+	bool isInstrumented() const;
+
+	bool isPlainMemory(uint8_t page) const;
+	bool isPlainReadMemory(uint8_t page) const; // Writes might still be trapped, e.g. ROM with mapper registers
+	void watchWrites(uint8_t page);
+
+	// Pages written to since the last clear, by the address they were written through: a write to a mirror doesn't
+	// mark the other mirrors, and remapping a page (e.g. a bank switch) doesn't mark it. Everything starts out dirty.
+	// Without EMUND_DIRTY_PAGES nothing is tracked, and every page always counts as dirty.
+	bool isPageDirty(uint8_t page) const;
+	PageSet getDirtyPages() const;
+	void clearDirtyPages();
+	PageSet takeDirtyPages();
 
 	void dump(uint16_t startAddress, uint16_t endAddress);
 
 private:
-	constexpr static size_t pageSize = 256;
-	constexpr static size_t numPages = 256;
+	enum PageFlags : uint8_t {
+		PageReadRegisters = 1,
+		PageWriteRegisters = 2,
+		PageWatched = 4, // Holds decoded code, see pageVersions
+		PageReadBreakpoints = 8,
+		PageWriteBreakpoints = 16,
+		PagePatched = 32
+	};
+
+	template <typename Handler>
+	struct Register {
+		uint8_t first;
+		uint8_t last;
+		Handler handler;
+		void* context;
+	};
+	using ReadRegister = Register<ReadHandler>;
+	using WriteRegister = Register<WriteHandler>;
+
+	struct Breakpoint {
+		uint8_t first;
+		uint8_t last;
+	};
 
 	uint8_t* memory[numPages];
+	uint8_t* sources[numPages]; // What memory would point at if it wasn't for patches
 	uint8_t masks[numPages];
+	uint8_t pageFlags[numPages];
 	uint8_t fallbackPage[pageSize];
 
-	uint16_t registersStartAddress = 0xFFFF;
-	uint16_t registersEndAddress = 0x0000;
-	struct Register {
-		uint16_t startAddress = 0xFFFF;
-		uint16_t endAddress = 0xFFFF;
-		RegisterCallback callback = nullptr;
-		void* data = nullptr;
-	};
-	std::array<Register, 4> registers;
+	// Pages holding decoded code get their version bumped whenever they're written to, through any mirror
+	uint32_t pageVersions[numPages];
+
+#ifdef EMUND_DIRTY_PAGES
+	// A byte per page rather than a bit, so marking one is a plain store
+	uint8_t dirtyPages[numPages];
+#endif
+
+	// Only consulted for pages flagged as having registers, latest mapping first
+	std::array<std::vector<ReadRegister>, numPages> readRegisters;
+	std::array<std::vector<WriteRegister>, numPages> writeRegisters;
+
+	// Likewise only consulted for pages flagged as having breakpoints
+	std::array<std::vector<Breakpoint>, numPages> readBreakpoints;
+	std::array<std::vector<Breakpoint>, numPages> writeBreakpoints;
+	size_t nBreakpoints = 0;
+	void* breakpointContext = nullptr;
+	BreakpointHandler breakpointHandler = nullptr;
+	BusProfiler* profiler = nullptr;
+	void* pagePatcherContext = nullptr;
+	PagePatcher pagePatcher = nullptr;
+
+	uint8_t readSlow(uint16_t address) const;
+	void writeSlow(uint16_t address, uint8_t value);
+	void onWatchedPageWrite(uint8_t page);
+	void updateRegisterFlags(uint8_t page);
+	void setPageMemory(uint8_t page, uint8_t* source);
+	void profileRead(uint16_t address) const;
+	void profileWrite(uint16_t address) const;
+	void addBreakpoint(std::array<std::vector<Breakpoint>, numPages>& breakpoints, PageFlags flag, uint16_t startAddress, uint16_t endAddress);
+	static bool isInRange(const std::vector<Breakpoint>& breakpoints, uint8_t offset);
 };
@@ -0,0 +1,152 @@
+#include "bus_profiler.h"
+
+#include <algorithm>
+#include <halley.hpp>
+using namespace Halley;
+
+namespace {
+	String toHex(uint32_t value, int digits)
+	{
+		return "$" + toString(value, 16, digits).asciiUpper();
+	}
+
+	String toPercentage(uint64_t count, uint64_t total)
+	{
+		return toString(total > 0 ? float(count) * 100.0f / float(total) : 0.0f, 2) + "%";
+	}
+}
+
+BusProfiler::BusProfiler()
+{
+	reads.resize(0x10000, 0);
+	writes.resize(0x10000, 0);
+}
+
+void BusProfiler::setInstructionPC(uint16_t pc)
+{
+	instructionPC = pc;
+}
+
+void BusProfiler::recordRead(uint16_t address)
+{
+	++reads[address];
+	++totalReads;
+	recordPC(address);
+}
+
+void BusProfiler::recordWrite(uint16_t address)
+{
+	++writes[address];
+	++totalWrites;
+	recordPC(address);
+}
+
+void BusProfiler::recordRegisterAccess(const void* handler, uint16_t address, bool write)
+{
+	auto& counts = registerCounts[handler];
+	++(write ? counts.writes : counts.reads);
+	counts.firstAddress = std::min(counts.firstAddress, address);
+	counts.lastAddress = std::max(counts.lastAddress, address);
+}
+
+void BusProfiler::recordPC(uint16_t address)
+{
+	if (instructionPC != noPC) {
+		++pcCounts[(uint32_t(address) << 16) | instructionPC];
+	}
+}
+
+void BusProfiler::clear()
+{
+	std::fill(reads.begin(), reads.end(), 0);
+	std::fill(writes.begin(), writes.end(), 0);
+	totalReads = 0;
+	totalWrites = 0;
+	registerCounts.clear();
+	pcCounts.clear();
+}
+
+uint64_t BusProfiler::getReads() const
+{
+	return totalReads;
+}
+
+uint64_t BusProfiler::getWrites() const
+{
+	return totalWrites;
+}
+
+void BusProfiler::log(const char* name, size_t n) const
+{
+	const uint64_t total = totalReads + totalWrites;
+	Logger::logInfo(String(name) + " bus traffic: " + toString(totalReads) + " reads, " + toString(totalWrites) + " writes");
+
+	// Pages, busiest first
+	struct Count {
+		uint32_t key;
+		uint64_t reads;
+		uint64_t writes;
+	};
+	std::vector<Count> pages;
+	for (uint32_t page = 0; page < 256; ++page) {
+		Count count{ page, 0, 0 };
+		for (uint32_t i = page << 8; i < ((page + 1) << 8); ++i) {
+			count.reads += reads[i];
+			count.writes += writes[i];
+		}
+		if (count.reads + count.writes > 0) {
+			pages.push_back(count);
+		}
+	}
+	const auto busiest = [] (const Count& a, const Count& b)
+	{
+		return a.reads + a.writes > b.reads + b.writes;
+	};
+	std::sort(pages.begin(), pages.end(), busiest);
+	pages.resize(std::min(pages.size(), n));
+	for (const auto& page: pages) {
+		Logger::logInfo("  Page " + toHex(page.key << 8, 4) + ": " + toString(page.reads) + " reads, " + toString(page.writes) + " writes ("
+			+ toPercentage(page.reads + page.writes, total) + ")");
+	}
+
+	for (const auto& [handler, counts]: registerCounts) {
+		Logger::logInfo("  Registers " + toHex(counts.firstAddress, 4) + "-" + toHex(counts.lastAddress, 4) + ": " + toString(counts.reads) + " reads, "
+			+ toString(counts.writes) + " writes (" + toPercentage(counts.reads + counts.writes, total) + ")");
+	}
+
+	// Addresses, busiest first, each with the instructions accessing it the most
+	std::vector<Count> addresses;
+	for (uint32_t address = 0; address < 0x10000; ++address) {
+		if (reads[address] + writes[address] > 0) {
+			addresses.push_back(Count{ address, reads[address], writes[address] });
+		}
+	}
+	n = std::min(n, addresses.size());
+	std::partial_sort(addresses.begin(), addresses.begin() + n, addresses.end(), busiest);
+	addresses.resize(n);
+
+	std::unordered_map<uint32_t, std::vector<std::pair<uint16_t, uint64_t>>> pcsByAddress;
+	for (const auto& address: addresses) {
+		pcsByAddress[address.key];
+	}
+	for (const auto& [key, count]: pcCounts) {
+		const auto iter = pcsByAddress.find(key >> 16);
+		if (iter != pcsByAddress.end()) {
+			iter->second.emplace_back(uint16_t(key & 0xFFFF), count);
+		}
+	}
+
+	for (const auto& address: addresses) {
+		String line = "  " + toHex(address.key, 4) + ": " + toString(address.reads) + " reads, " + toString(address.writes) + " writes";
+		auto& pcs = pcsByAddress[address.key];
+		const size_t nPCs = std::min(pcs.size(), pcsPerAddress);
+		std::partial_sort(pcs.begin(), pcs.begin() + nPCs, pcs.end(), [] (const auto& a, const auto& b)
+		{
+			return a.second > b.second;
+		});
+		for (size_t i = 0; i < nPCs; ++i) {
+			line += (i == 0 ? ", from " : ", ") + toHex(pcs[i].first, 4) + " x" + toString(pcs[i].second);
+		}
+		Logger::logInfo(line);
+	}
+}
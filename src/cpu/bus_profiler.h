@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Counts the traffic through an address space, per address and per register handler, and which instructions caused
+// it when told about them. Only fed by builds with EMUND_BUS_PROFILING.
+class BusProfiler {
+public:
+	BusProfiler();
+
+	// Accesses get attributed to this PC until it's changed, e.g. to the start of the instruction being run
+	void setInstructionPC(uint16_t pc);
+
+	void recordRead(uint16_t address);
+	void recordWrite(uint16_t address);
+	void recordRegisterAccess(const void* handler, uint16_t address, bool write);
+	void clear();
+
+	uint64_t getReads() const;
+	uint64_t getWrites() const;
+
+	// Logs the busiest pages and register handlers, and the n busiest addresses along with the PCs accessing them
+	void log(const char* name, size_t n) const;
+
+private:
+	constexpr static uint32_t noPC = 0x10000;
+	constexpr static size_t pcsPerAddress = 4;
+
+	struct RegisterCounts {
+		uint64_t reads = 0;
+		uint64_t writes = 0;
+		uint16_t firstAddress = 0xFFFF;
+		uint16_t lastAddress = 0;
+	};
+
+	std::vector<uint64_t> reads;
+	std::vector<uint64_t> writes;
+	uint64_t totalReads = 0;
+	uint64_t totalWrites = 0;
+	std::unordered_map<const void*, RegisterCounts> registerCounts;
+
+	uint32_t instructionPC = noPC;
+	std::unordered_map<uint32_t, uint64_t> pcCounts; // By address << 16 | PC
+
+	void recordPC(uint16_t address);
+};
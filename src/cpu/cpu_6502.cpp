@@ -1,7 +1,13 @@
 #include "cpu_6502.h"
 
 #include "address_space.h"
+#include "bus_profiler.h"
+#include "cpu_6502_histogram.h"
+#ifdef EMUND_CPU_JIT
+#include "cpu_6502_jit.h"
+#endif
 
+#include <limits>
 #include <halley.hpp>
 using namespace Halley;
 
@@ -19,54 +25,37 @@ constexpr uint8_t FLAG_ALL = 0xFF;
 #pragma warning(disable: 4996)
 #endif
 
-constexpr static uint8_t timings[256] = {
-//  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
-	7, 6, 0, 0, 3, 3, 5, 0, 3, 2, 2, 0, 4, 4, 6, 0, // 00
-	2, 5, 0, 0, 4, 4, 6, 0, 2, 4, 2, 0, 4, 4, 7, 0, // 10
-	6, 6, 0, 0, 3, 3, 5, 0, 4, 2, 2, 0, 4, 4, 6, 0, // 20
-	2, 5, 0, 0, 4, 4, 6, 0, 2, 4, 2, 0, 4, 4, 7, 0, // 30
-	6, 6, 0, 0, 3, 3, 5, 0, 3, 2, 2, 0, 3, 4, 6, 0, // 40
-	2, 5, 0, 0, 4, 4, 6, 0, 2, 4, 2, 0, 4, 4, 7, 0, // 50
-	6, 6, 0, 0, 3, 3, 5, 0, 4, 2, 2, 0, 5, 4, 6, 0, // 60
-	2, 5, 0, 0, 4, 4, 6, 0, 2, 4, 2, 0, 4, 4, 7, 0, // 70
-	2, 6, 0, 6, 3, 3, 3, 3, 2, 0, 2, 0, 4, 4, 4, 4, // 80
-	2, 6, 0, 0, 4, 4, 4, 4, 2, 5, 2, 0, 0, 5, 0, 0, // 90
-	2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 0, 4, 4, 4, 4, // A0
-	2, 5, 0, 5, 4, 4, 4, 4, 2, 4, 2, 0, 4, 4, 4, 4, // B0
-	2, 6, 0, 0, 3, 3, 5, 0, 2, 2, 2, 0, 4, 4, 6, 0, // C0
-	2, 5, 0, 0, 4, 4, 6, 0, 2, 4, 2, 0, 4, 4, 7, 0, // D0
-	2, 6, 0, 0, 3, 3, 5, 0, 2, 2, 2, 2, 4, 4, 6, 0, // E0
-	2, 5, 0, 0, 4, 4, 6, 0, 2, 4, 2, 0, 4, 4, 7, 0  // F0
-};
-
-constexpr static uint8_t timingExtra[256] = {
-//  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
-	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 00
-	1, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, // 10
-	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 20
-	1, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, // 30
-	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 40
-	1, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, // 50
-	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 60
-	1, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, // 70
-	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 80
-	1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 90
-	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // A0
-	1, 1, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 1, 1, // B0
-	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // C0
-	1, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, // D0
-	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // E0
-	1, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0  // F0
-};
-
 CPU6502::CPU6502()
 {
-	disassembler = std::make_unique<CPU6502Disassembler>();
+#ifdef EMUND_CPU_BLOCK_CACHE
+	decodedBlocks.resize(numDecodedBlocks);
+#endif
 }
 
+CPU6502::~CPU6502() = default;
+
 void CPU6502::setAddressSpace(AddressSpace8BitBy16Bit& addressSpace)
 {
 	this->addressSpace = &addressSpace;
+#ifdef EMUND_CPU_JIT
+	jit = std::make_unique<CPU6502JIT>(*this, addressSpace);
+#endif
+}
+
+void CPU6502::setDirectRAM(uint8_t* ram)
+{
+	directRAM = ram;
+}
+
+void CPU6502::setPollHorizonCallback(void* data, PollHorizonCallback callback)
+{
+	pollHorizonData = data;
+	pollHorizonCallback = callback;
+}
+
+void CPU6502::setPairHistogram(CPU6502PairHistogram* histogram)
+{
+	pairHistogram = histogram;
 }
 
 void CPU6502::printDebugInfo()
@@ -74,18 +63,129 @@ void CPU6502::printDebugInfo()
 	char bufferA[128];
 	char bufferB[128];
 
-	size_t n = disassembler->disassemble(addressSpace->read(regPC), addressSpace->read(regPC + 1), addressSpace->read(regPC + 2), bufferA);
-	std::snprintf(bufferB, 128, "%04hX                                            A:%02hhX X:%02hhX Y:%02hhX P:%02hhX SP:%02hhX CYC: %lli", regPC, regA, regX, regY, regP, regS, cycle);
+	size_t n = CPU6502Disassembler::disassemble(addressSpace->read(regPC), addressSpace->read(regPC + 1), addressSpace->read(regPC + 2), bufferA);
+	std::snprintf(bufferB, 128, "%04hX                                            A:%02hhX X:%02hhX Y:%02hhX P:%02hhX SP:%02hhX CYC: %lli", regPC, regA, regX, regY, getP(), regS, cycle);
 	memcpy(bufferB + 6, bufferA, std::min(strlen(bufferA), size_t(40)));
 	
 	Logger::logDev(String(bufferB));
 }
 
 void CPU6502::tick()
+{
+	if (isDebugging()) {
+		if (nExecuteBreakpoints > 0 && executeBreakpoints[regPC] && regPC != resumeBreakpointAddress) {
+			resumeBreakpointAddress = regPC;
+			hitBreakpoint();
+			return;
+		}
+		resumeBreakpointAddress = noBreakpointAddress;
+
+		startPC = regPC;
+		startCycle = cycle;
+		if (pairHistogram) {
+			pairHistogram->record(addressSpace->readDirect(regPC));
+		}
+#ifdef EMUND_BUS_PROFILING
+		if (auto* profiler = addressSpace->getProfiler()) {
+			profiler->setInstructionPC(regPC);
+		}
+#endif
+		stepInterpreter();
+		return;
+	}
+	step(std::numeric_limits<uint64_t>::max());
+}
+
+void CPU6502::runUntil(uint64_t targetCycle)
+{
+	if (breakpointHit) {
+		return;
+	}
+
+	// Stops at the deadline, on errors, and whenever an interrupt gets raised under our feet (e.g. by a register write)
+	pollIRQ();
+	interrupted = false;
+	if (isDebugging()) {
+		runDebug(targetCycle);
+		return;
+	}
+
+	while (cycle < targetCycle && error == ErrorType::OK && !interrupted) {
+		step(targetCycle);
+#ifdef EMUND_CPU_IDLE_LOOPS
+		if (regPC <= startPC && size_t(startPC - regPC) <= IdleLoop::maxLength) {
+			checkIdleLoop(targetCycle);
+		}
+#endif
+	}
+}
+
+bool CPU6502::isDebugging() const
+{
+	return pairHistogram || nExecuteBreakpoints > 0 || addressSpace->isInstrumented();
+}
+
+void CPU6502::runDebug(uint64_t targetCycle)
+{
+	// Every instruction has to be seen on its own here, so there's no block cache, JIT, fusion or idle loop skipping.
+	// Zero page and stack accesses also have to go through the address space, in case they're being watched.
+	uint8_t* const ram = directRAM;
+	if (addressSpace->isInstrumented()) {
+		directRAM = nullptr;
+	}
+	while (cycle < targetCycle && error == ErrorType::OK && !interrupted) {
+		tick();
+	}
+	directRAM = ram;
+}
+
+void CPU6502::step(uint64_t targetCycle)
 {
 	startPC = regPC;
+	startCycle = cycle;
+
+#if defined(EMUND_CPU_SWITCH_DISPATCH)
+	executeReference(loadImmediate());
+#else
+#ifdef EMUND_CPU_JIT
+	if (jit->run(targetCycle)) {
+		return;
+	}
+#endif
+#ifdef EMUND_CPU_BLOCK_CACHE
+	if (const auto* instruction = getDecodedInstruction()) {
+#ifdef EMUND_CPU_SUPERINSTRUCTIONS
+		// The second half of a fused pair still has to start before the deadline
+		if (instruction->fusedHandler && cycle + instruction->maxCycles < targetCycle) {
+			const auto& next = instruction[1];
+			regPC = next.pc + next.length;
+			decodedOperand = instruction->operand;
+			fusedOperand = next.operand;
+			fusedDeadline = targetCycle;
+			++currentBlockPosition;
+			instruction->fusedHandler(*this);
+			return;
+		}
+#endif
+		regPC += instruction->length;
+		decodedOperand = instruction->operand;
+		instruction->handler(*this);
+		return;
+	}
+#endif
+	stepInterpreter();
+#endif
+}
+
+void CPU6502::stepInterpreter()
+{
+	opcodeHandlers[loadImmediate()](*this);
+}
+
+void CPU6502::executeReference(uint8_t instruction)
+{
+	// Reference engine, decodes everything at runtime. Kept around to validate the threaded handlers against.
 	pageCrossed = false;
-	const auto instruction = loadImmediate();
 	const uint8_t addressMode = (instruction & 0x1C) >> 2;
 
 	switch (instruction) {
@@ -134,14 +234,14 @@ void CPU6502::tick()
 		}
 	case 0x90:
 		// BCC
-		if (const auto offset = static_cast<int8_t>(loadImmediate()); (regP & FLAG_CARRY) == 0) {
+		if (const auto offset = static_cast<int8_t>(loadImmediate()); !isFlagSet<FLAG_CARRY>()) {
 			regPC += offset;
 			updateBranchTakenTiming();
 		}
 		break;
 	case 0xB0:
 		// BCS
-		if (const auto offset = static_cast<int8_t>(loadImmediate()); (regP & FLAG_CARRY) != 0) {
+		if (const auto offset = static_cast<int8_t>(loadImmediate()); isFlagSet<FLAG_CARRY>()) {
 			regPC += offset;
 			updateBranchTakenTiming();
 		}
@@ -156,28 +256,28 @@ void CPU6502::tick()
 		break;
 	case 0xF0:
 		// BEQ
-		if (const auto offset = static_cast<int8_t>(loadImmediate()); (regP & FLAG_ZERO) != 0) {
+		if (const auto offset = static_cast<int8_t>(loadImmediate()); isFlagSet<FLAG_ZERO>()) {
 			regPC += offset;
 			updateBranchTakenTiming();
 		}
 		break;
 	case 0x30:
 		// BMI
-		if (const auto offset = static_cast<int8_t>(loadImmediate()); (regP & FLAG_NEGATIVE) != 0) {
+		if (const auto offset = static_cast<int8_t>(loadImmediate()); isFlagSet<FLAG_NEGATIVE>()) {
 			regPC += offset;
 			updateBranchTakenTiming();
 		}
 		break;
 	case 0xD0:
 		// BNE, Relative
-		if (const auto offset = static_cast<int8_t>(loadImmediate()); (regP & FLAG_ZERO) == 0) {
+		if (const auto offset = static_cast<int8_t>(loadImmediate()); !isFlagSet<FLAG_ZERO>()) {
 			regPC += offset;
 			updateBranchTakenTiming();
 		}
 		break;
 	case 0x10:
 		// BPL
-		if (const auto offset = static_cast<int8_t>(loadImmediate()); (regP & FLAG_NEGATIVE) == 0) {
+		if (const auto offset = static_cast<int8_t>(loadImmediate()); !isFlagSet<FLAG_NEGATIVE>()) {
 			regPC += offset;
 			updateBranchTakenTiming();
 		}
@@ -188,21 +288,21 @@ void CPU6502::tick()
 		break;
 	case 0x50:
 		// BVC
-		if (const auto offset = static_cast<int8_t>(loadImmediate()); (regP & FLAG_OVERFLOW) == 0) {
+		if (const auto offset = static_cast<int8_t>(loadImmediate()); !isFlagSet<FLAG_OVERFLOW>()) {
 			regPC += offset;
 			updateBranchTakenTiming();
 		}
 		break;
 	case 0x70:
 		// BVS
-		if (const auto offset = static_cast<int8_t>(loadImmediate()); (regP & FLAG_OVERFLOW) != 0) {
+		if (const auto offset = static_cast<int8_t>(loadImmediate()); isFlagSet<FLAG_OVERFLOW>()) {
 			regPC += offset;
 			updateBranchTakenTiming();
 		}
 		break;
 	case 0x18:
 		// CLC
-		regP &= ~FLAG_CARRY;
+		setCarry(0);
 		break;
 	case 0xD8:
 		// CLD
@@ -210,11 +310,11 @@ void CPU6502::tick()
 		break;
 	case 0x58:
 		// CLI
-		regP &= ~FLAG_INTERRUPT_DISABLE;
+		enableInterrupts();
 		break;
 	case 0xB8:
 		// CLV
-		regP &= ~FLAG_OVERFLOW;
+		setOverflow(false);
 		break;
 	case 0xC1:
 	case 0xC5:
@@ -400,7 +500,7 @@ void CPU6502::tick()
 		break;
 	case 0x08:
 		// PHP
-		storeStack(regP | FLAG_B0 | FLAG_B1);
+		storeStack(getP() | FLAG_B0 | FLAG_B1);
 		break;
 	case 0x48:
 		// PHA
@@ -413,13 +513,13 @@ void CPU6502::tick()
 		break;
 	case 0x28:
 		// PLP
-		regP = (loadStack() & ~(FLAG_B0)) | FLAG_B1;
+		setP((loadStack() & ~(FLAG_B0)) | FLAG_B1);
 		// This really should have B0 and B1 disabled I think?
 		break;
 	case 0x2A:
 		// ROL, accumulator
 		{
-			const uint8_t carry = (regP & FLAG_CARRY);
+			const uint8_t carry = getCarry();
 			const auto address = getAddress(addressMode);
 			auto m = addressSpace->read(address);
 			setCarry(regA & 0x80);
@@ -436,7 +536,7 @@ void CPU6502::tick()
 		{
 			const auto address = getAddress(addressMode);
 			auto m = addressSpace->read(address);
-			const uint8_t carry = (regP & FLAG_CARRY);
+			const uint8_t carry = getCarry();
 			setCarry(m & 0x80);
 			m = (m << 1) | carry;
 			setZN(m);
@@ -446,7 +546,7 @@ void CPU6502::tick()
 	case 0x6A:
 		// ROR, accumulator
 		{
-			const uint8_t carry = (regP & FLAG_CARRY);
+			const uint8_t carry = getCarry();
 			setCarry(regA & 1);
 			regA = (regA >> 1) | (carry << 7);
 			setZN(regA);
@@ -460,7 +560,7 @@ void CPU6502::tick()
 		{
 			const auto address = getAddress(addressMode);
 			auto m = addressSpace->read(address);
-			const uint8_t carry = (regP & FLAG_CARRY);
+			const uint8_t carry = getCarry();
 			setCarry(m & 1);
 			m = (m >> 1) | (carry << 7);
 			setZN(m);
@@ -469,7 +569,7 @@ void CPU6502::tick()
 		}
 	case 0x40:
 		// RTI
-		regP = (loadStack() & ~(FLAG_B0)) | FLAG_B1;
+		setP((loadStack() & ~(FLAG_B0)) | FLAG_B1);
 		// This really should have B0 and B1 disabled I think?
 		regPC = loadStack();
 		regPC |= uint16_t(loadStack()) << 8;
@@ -494,7 +594,7 @@ void CPU6502::tick()
 		break;
 	case 0x38:
 		// SEC
-		regP |= FLAG_CARRY;
+		setCarry(1);
 		break;
 	case 0xF8:
 		// SED
@@ -608,7 +708,633 @@ void CPU6502::tick()
 		errorInstruction = instruction;
 	}
 
-	cycle += timings[instruction] + (timingExtra[instruction] & uint8_t(pageCrossed));
+	const auto& info = getOpcodeInfo(instruction);
+	cycle += info.baseCycles + uint8_t(info.pagePenalty && pageCrossed);
+}
+
+template <uint8_t opcode, bool predecoded>
+void CPU6502::execute()
+{
+	// Threaded engine: one handler per opcode, with the addressing mode and timings resolved at compile time
+	constexpr auto& info = getOpcodeInfo(opcode);
+	constexpr auto operation = info.operation;
+	constexpr auto mode = info.mode;
+	constexpr bool pagePenalty = info.pagePenalty;
+
+	if constexpr (operation == Operation::ADC) {
+		addWithCarry(loadOperand<mode, pagePenalty, predecoded>());
+	} else if constexpr (operation == Operation::AND) {
+		regA &= loadOperand<mode, pagePenalty, predecoded>();
+		setZN(regA);
+	} else if constexpr (operation == Operation::ASL) {
+		modifyOperand<mode, predecoded>([&] (uint8_t m)
+		{
+			setCarry(m & 0x80);
+			m <<= 1;
+			setZN(m);
+			return m;
+		});
+	} else if constexpr (operation == Operation::BCC) {
+		branch<FLAG_CARRY, false, predecoded>();
+	} else if constexpr (operation == Operation::BCS) {
+		branch<FLAG_CARRY, true, predecoded>();
+	} else if constexpr (operation == Operation::BEQ) {
+		branch<FLAG_ZERO, true, predecoded>();
+	} else if constexpr (operation == Operation::BIT) {
+		bitTest(loadOperand<mode, pagePenalty, predecoded>());
+	} else if constexpr (operation == Operation::BMI) {
+		branch<FLAG_NEGATIVE, true, predecoded>();
+	} else if constexpr (operation == Operation::BNE) {
+		branch<FLAG_ZERO, false, predecoded>();
+	} else if constexpr (operation == Operation::BPL) {
+		branch<FLAG_NEGATIVE, false, predecoded>();
+	} else if constexpr (operation == Operation::BRK) {
+		raiseIRQ();
+	} else if constexpr (operation == Operation::BVC) {
+		branch<FLAG_OVERFLOW, false, predecoded>();
+	} else if constexpr (operation == Operation::BVS) {
+		branch<FLAG_OVERFLOW, true, predecoded>();
+	} else if constexpr (operation == Operation::CLC) {
+		setCarry(0);
+	} else if constexpr (operation == Operation::CLD) {
+		regP &= ~FLAG_DECIMAL;
+	} else if constexpr (operation == Operation::CLI) {
+		enableInterrupts();
+	} else if constexpr (operation == Operation::CLV) {
+		setOverflow(false);
+	} else if constexpr (operation == Operation::CMP) {
+		compare(regA, loadOperand<mode, pagePenalty, predecoded>());
+	} else if constexpr (operation == Operation::CPX) {
+		compare(regX, loadOperand<mode, pagePenalty, predecoded>());
+	} else if constexpr (operation == Operation::CPY) {
+		compare(regY, loadOperand<mode, pagePenalty, predecoded>());
+	} else if constexpr (operation == Operation::DEC) {
+		modifyOperand<mode, predecoded>([&] (uint8_t m)
+		{
+			--m;
+			setZN(m);
+			return m;
+		});
+	} else if constexpr (operation == Operation::DEX) {
+		--regX;
+		setZN(regX);
+	} else if constexpr (operation == Operation::DEY) {
+		--regY;
+		setZN(regY);
+	} else if constexpr (operation == Operation::EOR) {
+		regA ^= loadOperand<mode, pagePenalty, predecoded>();
+		setZN(regA);
+	} else if constexpr (operation == Operation::INC) {
+		modifyOperand<mode, predecoded>([&] (uint8_t m)
+		{
+			++m;
+			setZN(m);
+			return m;
+		});
+	} else if constexpr (operation == Operation::INX) {
+		++regX;
+		setZN(regX);
+	} else if constexpr (operation == Operation::INY) {
+		++regY;
+		setZN(regY);
+	} else if constexpr (operation == Operation::JMP) {
+		regPC = getAddress<mode, false, predecoded>();
+	} else if constexpr (operation == Operation::JSR) {
+		const auto addr = fetchOperand<mode, predecoded>();
+		--regPC;
+		storeStack(regPC >> 8);
+		storeStack(regPC & 0xFF);
+		regPC = addr;
+	} else if constexpr (operation == Operation::LDA) {
+		regA = loadOperand<mode, pagePenalty, predecoded>();
+		setZN(regA);
+	} else if constexpr (operation == Operation::LDX) {
+		regX = loadOperand<mode, pagePenalty, predecoded>();
+		setZN(regX);
+	} else if constexpr (operation == Operation::LDY) {
+		regY = loadOperand<mode, pagePenalty, predecoded>();
+		setZN(regY);
+	} else if constexpr (operation == Operation::LSR) {
+		modifyOperand<mode, predecoded>([&] (uint8_t m)
+		{
+			setCarry(m & 1);
+			m >>= 1;
+			setZN(m);
+			return m;
+		});
+	} else if constexpr (operation == Operation::NOP) {
+		if constexpr (mode != AddressMode::Implied) {
+			loadOperand<mode, pagePenalty, predecoded>();
+		}
+	} else if constexpr (operation == Operation::ORA) {
+		regA |= loadOperand<mode, pagePenalty, predecoded>();
+		setZN(regA);
+	} else if constexpr (operation == Operation::PHA) {
+		storeStack(regA);
+	} else if constexpr (operation == Operation::PHP) {
+		storeStack(getP() | FLAG_B0 | FLAG_B1);
+	} else if constexpr (operation == Operation::PLA) {
+		regA = loadStack();
+		setZN(regA);
+	} else if constexpr (operation == Operation::PLP) {
+		setP((loadStack() & ~(FLAG_B0)) | FLAG_B1);
+	} else if constexpr (operation == Operation::ROL) {
+		modifyOperand<mode, predecoded>([&] (uint8_t m)
+		{
+			const uint8_t carry = getCarry();
+			setCarry(m & 0x80);
+			m = (m << 1) | carry;
+			setZN(m);
+			return m;
+		});
+	} else if constexpr (operation == Operation::ROR) {
+		modifyOperand<mode, predecoded>([&] (uint8_t m)
+		{
+			const uint8_t carry = getCarry();
+			setCarry(m & 1);
+			m = (m >> 1) | (carry << 7);
+			setZN(m);
+			return m;
+		});
+	} else if constexpr (operation == Operation::RTI) {
+		setP((loadStack() & ~(FLAG_B0)) | FLAG_B1);
+		regPC = loadStack();
+		regPC |= uint16_t(loadStack()) << 8;
+	} else if constexpr (operation == Operation::RTS) {
+		regPC = loadStack();
+		regPC |= uint16_t(loadStack()) << 8;
+		++regPC;
+	} else if constexpr (operation == Operation::SBC) {
+		subWithCarry(loadOperand<mode, pagePenalty, predecoded>());
+	} else if constexpr (operation == Operation::SEC) {
+		setCarry(1);
+	} else if constexpr (operation == Operation::SED) {
+		regP |= FLAG_DECIMAL;
+	} else if constexpr (operation == Operation::SEI) {
+		regP |= FLAG_INTERRUPT_DISABLE;
+	} else if constexpr (operation == Operation::STA) {
+		storeOperand<mode, predecoded>(regA);
+	} else if constexpr (operation == Operation::STX) {
+		storeOperand<mode, predecoded>(regX);
+	} else if constexpr (operation == Operation::STY) {
+		storeOperand<mode, predecoded>(regY);
+	} else if constexpr (operation == Operation::TAX) {
+		regX = regA;
+		setZN(regX);
+	} else if constexpr (operation == Operation::TAY) {
+		regY = regA;
+		setZN(regY);
+	} else if constexpr (operation == Operation::TSX) {
+		regX = regS;
+		setZN(regX);
+	} else if constexpr (operation == Operation::TXA) {
+		regA = regX;
+		setZN(regA);
+	} else if constexpr (operation == Operation::TXS) {
+		regS = regX;
+	} else if constexpr (operation == Operation::TYA) {
+		regA = regY;
+		setZN(regA);
+	} else if constexpr (operation == Operation::LAX) {
+		regX = regA = loadOperand<mode, pagePenalty, predecoded>();
+		setZN(regA);
+	} else if constexpr (operation == Operation::SAX) {
+		storeOperand<mode, predecoded>(regA & regX);
+	} else {
+		error = ErrorType::UnknownInstruction;
+		errorInstruction = opcode;
+	}
+
+	cycle += info.baseCycles;
+}
+
+template <uint8_t opcode, bool predecoded>
+void CPU6502::executeHandler(CPU6502& cpu)
+{
+	// Plain function pointers are both smaller and cheaper to call than member function pointers
+	cpu.execute<opcode, predecoded>();
+}
+
+template <bool predecoded, size_t... opcodes>
+constexpr std::array<CPU6502::OpcodeHandler, 256> CPU6502::makeOpcodeHandlers(std::index_sequence<opcodes...>)
+{
+	return {{ &CPU6502::executeHandler<static_cast<uint8_t>(opcodes), predecoded>... }};
+}
+
+const std::array<CPU6502::OpcodeHandler, 256> CPU6502::opcodeHandlers = makeOpcodeHandlers<false>(std::make_index_sequence<256>());
+const std::array<CPU6502::OpcodeHandler, 256> CPU6502::predecodedOpcodeHandlers = makeOpcodeHandlers<true>(std::make_index_sequence<256>());
+
+#ifdef EMUND_CPU_SUPERINSTRUCTIONS
+namespace {
+	struct FusedPair {
+		uint8_t first;
+		uint8_t second;
+	};
+
+	// Chosen from what typical game code does a lot of: copies, countdown loops, and tests followed by a branch
+	constexpr FusedPair fusedPairs[] = {
+		{ 0xA9, 0x85 }, { 0xA9, 0x8D }, { 0xA9, 0x9D }, { 0xA9, 0x99 }, { 0xA9, 0x91 }, // LDA #imm / STA
+		{ 0xA5, 0x85 }, { 0xA5, 0x8D }, { 0xA5, 0x9D }, { 0xA5, 0x99 }, { 0xA5, 0x91 }, // LDA zp / STA
+		{ 0xAD, 0x85 }, { 0xAD, 0x8D }, { 0xAD, 0x9D }, { 0xAD, 0x99 }, { 0xAD, 0x91 }, // LDA abs / STA
+		{ 0xBD, 0x85 }, { 0xBD, 0x8D }, { 0xBD, 0x9D }, { 0xBD, 0x99 }, { 0xBD, 0x91 }, // LDA abs,X / STA
+		{ 0xB9, 0x85 }, { 0xB9, 0x8D }, { 0xB9, 0x9D }, { 0xB9, 0x99 }, { 0xB9, 0x91 }, // LDA abs,Y / STA
+		{ 0xCA, 0xD0 }, { 0x88, 0xD0 }, { 0xE8, 0xD0 }, { 0xC8, 0xD0 }, // DEX, DEY, INX, INY / BNE
+		{ 0xE6, 0xD0 }, { 0xC6, 0xD0 }, // INC zp, DEC zp / BNE
+		{ 0xC9, 0xD0 }, { 0xC9, 0xF0 }, { 0xE0, 0xD0 }, { 0xC0, 0xD0 }, // CMP #imm / BNE, BEQ, CPX #imm, CPY #imm / BNE
+		{ 0xA5, 0xD0 }, { 0xA5, 0xF0 }, { 0x29, 0xD0 }, { 0x29, 0xF0 }, // LDA zp, AND #imm / BNE, BEQ
+	};
+
+	constexpr size_t numFusedPairs = sizeof(fusedPairs) / sizeof(fusedPairs[0]);
+}
+
+template <uint8_t first, uint8_t second>
+void CPU6502::executeFused()
+{
+	constexpr auto firstOperation = getOpcodeInfo(first).operation;
+	if constexpr ((firstOperation == Operation::DEX || firstOperation == Operation::DEY) && getOpcodeInfo(second).operation == Operation::BNE) {
+		// A countdown loop on itself: do every pass but the last that fits before the deadline in one go
+		if (static_cast<int8_t>(fusedOperand) == -3) {
+			uint8_t& counter = firstOperation == Operation::DEX ? regX : regY;
+			const uint16_t loopPC = regPC - 3;
+			const uint64_t passCycles = isSamePage(loopPC, regPC) ? 5 : 6;
+			const uint64_t passesLeft = counter == 0 ? 256 : counter;
+			const uint64_t passesToDeadline = (fusedDeadline - cycle - 2 + passCycles - 1) / passCycles;
+			const uint64_t passes = std::min(passesLeft - 1, passesToDeadline);
+			if (passes > 0) {
+				counter -= static_cast<uint8_t>(passes);
+				setZN(counter);
+				cycle += passes * passCycles;
+				regPC = loopPC;
+				return;
+			}
+		}
+	}
+
+	execute<first, true>();
+	startCycle = cycle;
+	decodedOperand = fusedOperand;
+	execute<second, true>();
+}
+
+template <uint8_t first, uint8_t second>
+void CPU6502::executeFusedHandler(CPU6502& cpu)
+{
+	cpu.executeFused<first, second>();
+}
+
+template <size_t... indices>
+constexpr std::array<CPU6502::OpcodeHandler, sizeof...(indices)> CPU6502::makeFusedHandlers(std::index_sequence<indices...>)
+{
+	return {{ &CPU6502::executeFusedHandler<fusedPairs[indices].first, fusedPairs[indices].second>... }};
+}
+
+CPU6502::OpcodeHandler CPU6502::getFusedHandler(uint8_t first, uint8_t second)
+{
+	constexpr static auto handlers = makeFusedHandlers(std::make_index_sequence<numFusedPairs>());
+	for (size_t i = 0; i < numFusedPairs; ++i) {
+		if (fusedPairs[i].first == first && fusedPairs[i].second == second) {
+			return handlers[i];
+		}
+	}
+	return nullptr;
+}
+
+void CPU6502::fuseInstructions(DecodedBlock& block)
+{
+	const uint8_t page = block.startPC >> 8;
+	for (size_t i = 0; i + 1 < block.nInstructions; ++i) {
+		auto& instruction = block.instructions[i];
+		const auto& info = getOpcodeInfo(instruction.opcode);
+
+		// The first instruction can't touch registers, as that could raise an interrupt between the two,
+		// and mustn't write over the block it's in
+		const uint16_t operand = instruction.operand;
+		bool plain;
+		switch (info.mode) {
+		case AddressMode::Implied:
+		case AddressMode::Accumulator:
+		case AddressMode::Immediate:
+			plain = true;
+			break;
+		case AddressMode::ZeroPage:
+			plain = addressSpace->isPlainMemory(0) && page != 0;
+			break;
+		case AddressMode::Absolute:
+			plain = addressSpace->isPlainReadMemory(operand >> 8);
+			break;
+		case AddressMode::AbsoluteX:
+		case AddressMode::AbsoluteY:
+			plain = addressSpace->isPlainReadMemory(operand >> 8) && addressSpace->isPlainReadMemory(uint16_t(operand + 0xFF) >> 8);
+			break;
+		default:
+			plain = false;
+			break;
+		}
+
+		if (plain) {
+			instruction.fusedHandler = getFusedHandler(instruction.opcode, block.instructions[i + 1].opcode);
+		}
+	}
+}
+#endif
+
+const CPU6502::DecodedInstruction* CPU6502::getDecodedInstruction()
+{
+	// Carry on with the current block if execution simply fell through to its next instruction
+	if (currentBlock && currentBlockPosition < currentBlock->nInstructions) {
+		const auto& instruction = currentBlock->instructions[currentBlockPosition];
+		if (instruction.pc == regPC && isBlockValid(*currentBlock)) {
+			++currentBlockPosition;
+			return &instruction;
+		}
+	}
+
+	auto& block = decodedBlocks[(regPC ^ (regPC >> 11)) & (numDecodedBlocks - 1)];
+	if (block.startPC != regPC || !isBlockValid(block)) {
+		if (!addressSpace->isPlainReadMemory(regPC >> 8) || isDirectRAMPage(regPC >> 8)) {
+			currentBlock = nullptr;
+			return nullptr;
+		}
+		decodeBlock(block, regPC);
+	}
+
+	if (block.nInstructions == 0) {
+		currentBlock = nullptr;
+		return nullptr;
+	}
+	currentBlock = &block;
+	currentBlockPosition = 1;
+	return &block.instructions[0];
+}
+
+void CPU6502::decodeBlock(DecodedBlock& block, uint16_t pc)
+{
+	// Blocks never leave the page they start on, so they only depend on that page's mapping and contents
+	const uint8_t page = pc >> 8;
+	block.startPC = pc;
+	block.page = addressSpace->getPage(page);
+	block.pageVersion = addressSpace->getPageVersion(page);
+	block.nInstructions = 0;
+
+	while (block.nInstructions < DecodedBlock::maxInstructions) {
+		const uint8_t opcode = addressSpace->readDirect(pc);
+		const uint8_t length = getOpcodeInfo(opcode).length;
+		if ((pc & 0xFF) + length > 0x100) {
+			// Straddles the page boundary, leave it to the regular interpreter
+			break;
+		}
+
+		const auto& info = getOpcodeInfo(opcode);
+		auto& instruction = block.instructions[block.nInstructions++];
+		instruction.handler = predecodedOpcodeHandlers[opcode];
+		instruction.fusedHandler = nullptr;
+		instruction.pc = pc;
+		instruction.opcode = opcode;
+		instruction.length = length;
+		instruction.maxCycles = info.baseCycles + (info.pagePenalty ? 1 : 0);
+		instruction.operand = 0;
+		if (length >= 2) {
+			instruction.operand |= addressSpace->readDirect(pc + 1);
+		}
+		if (length == 3) {
+			instruction.operand |= uint16_t(addressSpace->readDirect(pc + 2)) << 8;
+		}
+
+		pc += length;
+		if (getOpcodeInfo(opcode).blockEnd || (pc & 0xFF) == 0) {
+			break;
+		}
+	}
+
+#ifdef EMUND_CPU_SUPERINSTRUCTIONS
+	fuseInstructions(block);
+#endif
+	addressSpace->watchWrites(page);
+}
+
+bool CPU6502::isBlockValid(const DecodedBlock& block) const
+{
+	const uint8_t page = block.startPC >> 8;
+	return block.page == addressSpace->getPage(page) && block.pageVersion == addressSpace->getPageVersion(page);
+}
+
+void CPU6502::checkIdleLoop(uint64_t targetCycle)
+{
+	// We just jumped a short way back to regPC. If that closes an idle loop, and the previous pass through it left
+	// every register exactly as it found it, all further passes will do the same until something they read changes,
+	// so we can skip straight to that point.
+	auto& loop = idleLoops[regPC % numIdleLoops];
+	const uint8_t page = regPC >> 8;
+	if (loop.startPC != regPC || loop.page != addressSpace->getPage(page) || loop.pageVersion != addressSpace->getPageVersion(page)) {
+		analyseIdleLoop(loop, regPC);
+	}
+
+	// Only count arrivals from the end of the loop (or from a native block that started at the top of it)
+	if (!loop.idle || (startPC != loop.endPC && startPC != loop.startPC)) {
+		return;
+	}
+
+	const bool sameState = loop.arrivalInterrupts == interruptCount && loop.regA == regA && loop.regX == regX
+		&& loop.regY == regY && loop.regS == regS && loop.regP == getP();
+	if (sameState) {
+		uint64_t period = loop.baseCycles;
+		uint64_t horizon = targetCycle;
+		for (size_t i = 0; i < loop.nReads; ++i) {
+			bool crossed = false;
+			const uint16_t address = getIdleLoopReadAddress(loop.reads[i], crossed);
+			period += crossed ? 1 : 0;
+			if (!addressSpace->isPlainReadMemory(address >> 8)) {
+				horizon = std::min(horizon, pollHorizonCallback ? pollHorizonCallback(pollHorizonData, address, loop.arrivalCycle) : 0);
+			}
+		}
+
+		// A different cycle count means we didn't just go once around the loop
+		if (cycle - loop.arrivalCycle == period && horizon > cycle) {
+			cycle += (horizon - cycle) / period * period;
+		}
+	}
+
+	loop.arrivalCycle = cycle;
+	loop.arrivalInterrupts = interruptCount;
+	loop.regA = regA;
+	loop.regX = regX;
+	loop.regY = regY;
+	loop.regS = regS;
+	loop.regP = getP();
+}
+
+void CPU6502::analyseIdleLoop(IdleLoop& loop, uint16_t pc)
+{
+	const uint8_t page = pc >> 8;
+	loop.startPC = pc;
+	loop.endPC = pc;
+	loop.idle = false;
+	loop.page = addressSpace->getPage(page);
+	loop.pageVersion = addressSpace->getPageVersion(page);
+	loop.baseCycles = 0;
+	loop.nReads = 0;
+	loop.arrivalInterrupts = 0;
+	if (!addressSpace->isPlainReadMemory(page) || isDirectRAMPage(page)) {
+		return;
+	}
+	addressSpace->watchWrites(page);
+
+	bool writesX = false;
+	bool writesY = false;
+	bool indexedX = false;
+	bool indexedY = false;
+	
+	while (size_t(pc - loop.startPC) <= IdleLoop::maxLength) {
+		const uint8_t opcode = addressSpace->readDirect(pc);
+		const auto& info = getOpcodeInfo(opcode);
+		if (((pc + info.length - 1) >> 8) != page) {
+			return;
+		}
+		const uint16_t operand = info.length == 3 ? addressSpace->readDirect(pc + 1) | (addressSpace->readDirect(pc + 2) << 8) : addressSpace->readDirect(pc + 1);
+		loop.baseCycles += info.baseCycles;
+
+		// The loop has to close with a branch or jump back to the start, and nothing else may leave it
+		if (info.mode == AddressMode::Relative || info.operation == Operation::JMP) {
+			const bool closes = info.mode == AddressMode::Relative
+				? uint16_t(pc + 2 + int8_t(operand)) == loop.startPC
+				: info.mode == AddressMode::Absolute && operand == loop.startPC;
+			if (!closes || (writesX && indexedX) || (writesY && indexedY)) {
+				return;
+			}
+			if (info.mode == AddressMode::Relative) {
+				loop.baseCycles += isSamePage(loop.startPC, pc + 2) ? 1 : 2;
+			}
+			loop.endPC = pc;
+			loop.idle = true;
+			return;
+		}
+
+		switch (info.operation) {
+		case Operation::ASL:
+		case Operation::LSR:
+		case Operation::ROL:
+		case Operation::ROR:
+			if (info.mode != AddressMode::Accumulator) {
+				return;
+			}
+			break;
+		case Operation::ADC:
+		case Operation::AND:
+		case Operation::BIT:
+		case Operation::CMP:
+		case Operation::CPX:
+		case Operation::CPY:
+		case Operation::EOR:
+		case Operation::LDA:
+		case Operation::LDX:
+		case Operation::LDY:
+		case Operation::LAX:
+		case Operation::NOP:
+		case Operation::ORA:
+		case Operation::SBC:
+		case Operation::CLC:
+		case Operation::CLD:
+		case Operation::CLV:
+		case Operation::SEC:
+		case Operation::SED:
+		case Operation::TAX:
+		case Operation::TAY:
+		case Operation::TSX:
+		case Operation::TXA:
+		case Operation::TXS:
+		case Operation::TYA:
+		case Operation::INX:
+		case Operation::INY:
+		case Operation::DEX:
+		case Operation::DEY:
+			break;
+		default:
+			// Writes, stack traffic, or control flow
+			return;
+		}
+
+		switch (info.operation) {
+		case Operation::LDX: case Operation::LAX: case Operation::TAX: case Operation::TSX: case Operation::INX: case Operation::DEX:
+			writesX = true;
+			break;
+		case Operation::LDY: case Operation::TAY: case Operation::INY: case Operation::DEY:
+			writesY = true;
+			break;
+		default:
+			break;
+		}
+
+		switch (info.mode) {
+		case AddressMode::ZeroPageX:
+		case AddressMode::AbsoluteX:
+		case AddressMode::IndirectX:
+			indexedX = true;
+			break;
+		case AddressMode::ZeroPageY:
+		case AddressMode::AbsoluteY:
+		case AddressMode::IndirectY:
+			indexedY = true;
+			break;
+		default:
+			break;
+		}
+
+		switch (info.mode) {
+		case AddressMode::Implied:
+		case AddressMode::Accumulator:
+		case AddressMode::Immediate:
+			break;
+		default:
+			// Read addresses are worked out when skipping, from the registers we arrive with; the check above makes sure
+			// the index registers can't change before they're used
+			if (loop.nReads == IdleLoop::maxReads) {
+				return;
+			}
+			loop.reads[loop.nReads++] = pc;
+			break;
+		}
+
+		pc += info.length;
+	}
+}
+
+uint16_t CPU6502::getIdleLoopReadAddress(uint16_t pc, bool& crossed) const
+{
+	const auto& info = getOpcodeInfo(addressSpace->readDirect(pc));
+	const uint8_t low = addressSpace->readDirect(pc + 1);
+	const uint16_t absolute = low | (addressSpace->readDirect(pc + 2) << 8);
+
+	auto indexed = [&] (uint16_t base, uint8_t offset) -> uint16_t
+	{
+		const uint16_t address = base + offset;
+		crossed = info.pagePenalty && (base & 0xFF00) != (address & 0xFF00);
+		return address;
+	};
+	auto pointer = [&] (uint8_t zeroPage) -> uint16_t
+	{
+		return addressSpace->readDirect(zeroPage) | (addressSpace->readDirect(uint8_t(zeroPage + 1)) << 8);
+	};
+
+	switch (info.mode) {
+	case AddressMode::ZeroPage:
+		return low;
+	case AddressMode::ZeroPageX:
+		return uint8_t(low + regX);
+	case AddressMode::ZeroPageY:
+		return uint8_t(low + regY);
+	case AddressMode::Absolute:
+		return absolute;
+	case AddressMode::AbsoluteX:
+		return indexed(absolute, regX);
+	case AddressMode::AbsoluteY:
+		return indexed(absolute, regY);
+	case AddressMode::IndirectX:
+		return pointer(uint8_t(low + regX));
+	case AddressMode::IndirectY:
+		return indexed(pointer(low), regY);
+	default:
+		return 0;
+	}
 }
 
 void CPU6502::raiseIRQ()
@@ -618,6 +1344,71 @@ void CPU6502::raiseIRQ()
 	}
 }
 
+void CPU6502::setIRQLine(bool asserted)
+{
+	irqLine = asserted;
+	pollIRQ();
+}
+
+bool CPU6502::getIRQLine() const
+{
+	return irqLine;
+}
+
+void CPU6502::pollIRQ()
+{
+	if (irqLine && (regP & FLAG_INTERRUPT_DISABLE) == 0) {
+		startInterrupt(0xFFFE);
+	}
+}
+
+void CPU6502::enableInterrupts()
+{
+	regP &= ~FLAG_INTERRUPT_DISABLE;
+	if (irqLine) {
+		// Come back out of runUntil, which takes the IRQ on its way back in
+		interrupted = true;
+	}
+}
+
+void CPU6502::stopRun()
+{
+	interrupted = true;
+}
+
+void CPU6502::addExecuteBreakpoint(uint16_t address)
+{
+	if (executeBreakpoints.empty()) {
+		executeBreakpoints.resize(0x10000, false);
+	}
+	if (!executeBreakpoints[address]) {
+		executeBreakpoints[address] = true;
+		++nExecuteBreakpoints;
+	}
+}
+
+void CPU6502::clearExecuteBreakpoints()
+{
+	executeBreakpoints.clear();
+	nExecuteBreakpoints = 0;
+}
+
+void CPU6502::hitBreakpoint()
+{
+	breakpointHit = true;
+	interrupted = true;
+}
+
+bool CPU6502::hasHitBreakpoint() const
+{
+	return breakpointHit;
+}
+
+void CPU6502::clearBreakpointHit()
+{
+	breakpointHit = false;
+}
+
 void CPU6502::raiseNMI()
 {
 	startInterrupt(0xFFFA);
@@ -634,8 +1425,10 @@ void CPU6502::startInterrupt(uint16_t address)
 {
 	storeStack(regPC >> 8);
 	storeStack(regPC & 0xFF);
-	storeStack(regP | FLAG_B0 | FLAG_B1);
+	storeStack(getP() | FLAG_B0 | FLAG_B1);
 	regP |= FLAG_INTERRUPT_DISABLE;
+	interrupted = true;
+	++interruptCount;
 
 	regPC = addressSpace->read(address);
 	regPC |= static_cast<uint16_t>(addressSpace->read(address + 1)) << 8;
@@ -663,23 +1456,112 @@ uint64_t CPU6502::getCycle() const
 	return cycle;
 }
 
-void CPU6502::copyOAM(uint8_t highAddr, gsl::span<uint8_t> oamData)
+uint64_t CPU6502::getInstructionStartCycle() const
+{
+	return startCycle;
+}
+
+#ifdef EMUND_CPU_JIT
+void CPU6502::setJITVerification(bool enabled)
+{
+	jit->setVerification(enabled);
+}
+
+size_t CPU6502::getJITVerificationFailures() const
+{
+	return jit->getVerificationFailures();
+}
+#endif
+
+void CPU6502::stall(uint32_t cycles)
+{
+	cycle += cycles;
+}
+
+uint16_t CPU6502::getPC() const
+{
+	return regPC;
+}
+
+uint8_t CPU6502::getP() const
+{
+#ifdef EMUND_CPU_LAZY_FLAGS
+	return (regP & ~(FLAG_CARRY | FLAG_ZERO | FLAG_OVERFLOW | FLAG_NEGATIVE))
+		| carryFlag
+		| (zeroResult == 0 ? FLAG_ZERO : 0)
+		| ((overflowResult & 0x80) >> 1)
+		| (negativeResult & 0x80);
+#else
+	return regP;
+#endif
+}
+
+void CPU6502::setP(uint8_t value)
+{
+	regP = value;
+	if (irqLine && (value & FLAG_INTERRUPT_DISABLE) == 0) {
+		interrupted = true;
+	}
+#ifdef EMUND_CPU_LAZY_FLAGS
+	carryFlag = value & FLAG_CARRY;
+	zeroResult = ~value & FLAG_ZERO;
+	overflowResult = uint8_t((value & FLAG_OVERFLOW) << 1);
+	negativeResult = value;
+#endif
+}
+
+template <uint8_t flag>
+bool CPU6502::isFlagSet() const
 {
-	for (uint16_t i = 0; i < 256; ++i) {
-		uint16_t address = (uint16_t(highAddr) << 8) | (i & 0xFF);
-		oamData[i] = addressSpace->read(address);
+#ifdef EMUND_CPU_LAZY_FLAGS
+	if constexpr (flag == FLAG_CARRY) {
+		return carryFlag != 0;
+	} else if constexpr (flag == FLAG_ZERO) {
+		return zeroResult == 0;
+	} else if constexpr (flag == FLAG_OVERFLOW) {
+		return (overflowResult & 0x80) != 0;
+	} else if constexpr (flag == FLAG_NEGATIVE) {
+		return (negativeResult & 0x80) != 0;
 	}
-	cycle += 513 + (cycle & 1);
+#endif
+	return (regP & flag) != 0;
+}
+
+uint8_t CPU6502::getCarry() const
+{
+#ifdef EMUND_CPU_LAZY_FLAGS
+	return carryFlag;
+#else
+	return regP & FLAG_CARRY;
+#endif
 }
 
 void CPU6502::setZN(uint8_t value)
 {
+#ifdef EMUND_CPU_LAZY_FLAGS
+	zeroResult = value;
+	negativeResult = value;
+#else
 	regP = (regP & ~(FLAG_ZERO | FLAG_NEGATIVE)) | (value == 0 ? FLAG_ZERO : 0) | (value & 0x80 ? FLAG_NEGATIVE : 0);
+#endif
 }
 
 void CPU6502::setCarry(uint8_t value)
 {
+#ifdef EMUND_CPU_LAZY_FLAGS
+	carryFlag = value ? FLAG_CARRY : 0;
+#else
 	regP = (regP & ~FLAG_CARRY) | (value ? FLAG_CARRY : 0);
+#endif
+}
+
+void CPU6502::setOverflow(bool value)
+{
+#ifdef EMUND_CPU_LAZY_FLAGS
+	overflowResult = value ? 0x80 : 0;
+#else
+	regP = (regP & ~FLAG_OVERFLOW) | (value ? FLAG_OVERFLOW : 0);
+#endif
 }
 
 uint8_t CPU6502::loadImmediate()
@@ -696,7 +1578,7 @@ uint16_t CPU6502::loadImmediate16()
 
 uint8_t CPU6502::loadZeroPage()
 {
-	return addressSpace->read(getZeroPage());
+	return readLowRAM(getZeroPage());
 }
 
 uint8_t CPU6502::loadAbsolute()
@@ -751,15 +1633,15 @@ uint16_t CPU6502::getZeroPagePlus(uint8_t offset)
 uint16_t CPU6502::getIndirectX()
 {
 	const uint8_t immediate = loadImmediate();
-	const auto lowAddr = addressSpace->read(uint8_t(immediate + regX));
-	const auto highAddr = addressSpace->read(uint8_t(immediate + regX + 1));
+	const auto lowAddr = readLowRAM(uint8_t(immediate + regX));
+	const auto highAddr = readLowRAM(uint8_t(immediate + regX + 1));
 	return static_cast<uint16_t>(lowAddr) | (static_cast<uint16_t>(highAddr) << 8);
 }
 
 uint16_t CPU6502::getIndirectY()
 {	const auto tablePos = loadImmediate();
-	const auto lowAddr = addressSpace->read(uint8_t(tablePos));
-	const auto highAddr = addressSpace->read(uint8_t(tablePos + 1));
+	const auto lowAddr = readLowRAM(uint8_t(tablePos));
+	const auto highAddr = readLowRAM(uint8_t(tablePos + 1));
 	const auto addr = static_cast<uint16_t>(lowAddr) | (static_cast<uint16_t>(highAddr) << 8);
 	const auto finalAddr = addr + regY;
 	pageCrossed = !isSamePage(addr, finalAddr);
@@ -812,6 +1694,109 @@ uint16_t CPU6502::getAddressX(uint8_t mode)
 	}
 }
 
+template <CPU6502::AddressMode mode, bool predecoded>
+uint16_t CPU6502::fetchOperand()
+{
+	if constexpr (predecoded) {
+		return decodedOperand;
+	} else if constexpr (CPU6502Opcodes::getLength(mode) == 3) {
+		return loadImmediate16();
+	} else {
+		return loadImmediate();
+	}
+}
+
+template <CPU6502::AddressMode mode, bool pagePenalty, bool predecoded>
+uint16_t CPU6502::getAddress()
+{
+	const uint16_t operand = fetchOperand<mode, predecoded>();
+
+	if constexpr (mode == AddressMode::ZeroPage || mode == AddressMode::Absolute) {
+		return operand;
+	} else if constexpr (mode == AddressMode::ZeroPageX) {
+		return uint8_t(operand + regX);
+	} else if constexpr (mode == AddressMode::ZeroPageY) {
+		return uint8_t(operand + regY);
+	} else if constexpr (mode == AddressMode::Indirect) {
+		// The 6502 doesn't carry into the high byte when fetching the pointer
+		const uint8_t lowAddr = addressSpace->read(operand);
+		const uint8_t highAddr = addressSpace->read(uint8_t((operand & 0xFF) + 1) | uint16_t(operand & 0xFF00));
+		return static_cast<uint16_t>(lowAddr) | (static_cast<uint16_t>(highAddr) << 8);
+	} else if constexpr (mode == AddressMode::IndirectX) {
+		const uint8_t tablePos = uint8_t(operand + regX);
+		const uint8_t lowAddr = readLowRAM(tablePos);
+		const uint8_t highAddr = readLowRAM(uint8_t(tablePos + 1));
+		return static_cast<uint16_t>(lowAddr) | (static_cast<uint16_t>(highAddr) << 8);
+	} else {
+		uint16_t baseAddr;
+		uint16_t addr;
+		if constexpr (mode == AddressMode::AbsoluteX) {
+			baseAddr = operand;
+			addr = baseAddr + regX;
+		} else if constexpr (mode == AddressMode::AbsoluteY) {
+			baseAddr = operand;
+			addr = baseAddr + regY;
+		} else {
+			static_assert(mode == AddressMode::IndirectY);
+			const uint8_t lowAddr = readLowRAM(uint8_t(operand));
+			const uint8_t highAddr = readLowRAM(uint8_t(operand + 1));
+			baseAddr = static_cast<uint16_t>(lowAddr) | (static_cast<uint16_t>(highAddr) << 8);
+			addr = baseAddr + regY;
+		}
+		if constexpr (pagePenalty) {
+			cycle += isSamePage(baseAddr, addr) ? 0 : 1;
+		}
+		return addr;
+	}
+}
+
+template <CPU6502::AddressMode mode, bool pagePenalty, bool predecoded>
+uint8_t CPU6502::loadOperand()
+{
+	if constexpr (mode == AddressMode::Immediate) {
+		return static_cast<uint8_t>(fetchOperand<mode, predecoded>());
+	} else if constexpr (isZeroPageMode(mode)) {
+		return readLowRAM(getAddress<mode, pagePenalty, predecoded>());
+	} else {
+		return addressSpace->read(getAddress<mode, pagePenalty, predecoded>());
+	}
+}
+
+template <CPU6502::AddressMode mode, bool predecoded>
+void CPU6502::storeOperand(uint8_t value)
+{
+	if constexpr (isZeroPageMode(mode)) {
+		writeLowRAM(getAddress<mode, false, predecoded>(), value);
+	} else {
+		addressSpace->write(getAddress<mode, false, predecoded>(), value);
+	}
+}
+
+template <CPU6502::AddressMode mode, bool predecoded, typename F>
+void CPU6502::modifyOperand(F f)
+{
+	if constexpr (mode == AddressMode::Accumulator) {
+		regA = f(regA);
+	} else if constexpr (isZeroPageMode(mode)) {
+		const auto address = getAddress<mode, false, predecoded>();
+		writeLowRAM(address, f(readLowRAM(address)));
+	} else {
+		const auto address = getAddress<mode, false, predecoded>();
+		addressSpace->write(address, f(addressSpace->read(address)));
+	}
+}
+
+template <uint8_t flag, bool set, bool predecoded>
+void CPU6502::branch()
+{
+	const auto offset = static_cast<int8_t>(fetchOperand<AddressMode::Relative, predecoded>());
+	if (isFlagSet<flag>() == set) {
+		const uint16_t nextPC = regPC;
+		regPC += offset;
+		cycle += isSamePage(regPC, nextPC) ? 1 : 2;
+	}
+}
+
 void CPU6502::storeAddressMode(uint8_t value, uint8_t mode)
 {
 	addressSpace->write(getAddress(mode), value);
@@ -822,55 +1807,100 @@ void CPU6502::storeAddressModeX(uint8_t value, uint8_t mode)
 	addressSpace->write(getAddressX(mode), value);
 }
 
+uint8_t CPU6502::readLowRAM(uint16_t address) const
+{
+	return directRAM ? directRAM[address] : addressSpace->read(address);
+}
+
+void CPU6502::writeLowRAM(uint16_t address, uint8_t value)
+{
+	if (directRAM) {
+		directRAM[address] = value;
+		addressSpace->markPageDirty(uint8_t(address >> 8));
+	} else {
+		addressSpace->write(address, value);
+	}
+}
+
+bool CPU6502::isDirectRAMPage(uint8_t page) const
+{
+	// Writes through directRAM don't bump page versions, so code living there can't be cached
+	const uint8_t* memory = addressSpace->getPage(page);
+	return directRAM && memory >= directRAM && memory < directRAM + 0x200;
+}
+
 void CPU6502::storeStack(uint8_t value)
 {
-	addressSpace->write(0x100 + regS--, value);
+	writeLowRAM(0x100 + regS--, value);
 }
 
 uint8_t CPU6502::loadStack()
 {
-	return addressSpace->read(0x100 + ++regS);
+	return readLowRAM(0x100 + ++regS);
 }
 
 void CPU6502::compare(uint8_t reg, uint8_t memory)
 {
+#ifdef EMUND_CPU_LAZY_FLAGS
+	carryFlag = reg >= memory ? FLAG_CARRY : 0;
+	zeroResult = negativeResult = uint8_t(reg - memory);
+#else
 	regP = (regP & ~(FLAG_CARRY | FLAG_ZERO | FLAG_NEGATIVE))
 		| (reg >= memory ? FLAG_CARRY : 0)
 		| (reg == memory ? FLAG_ZERO : 0)
 		| (((reg - memory) & 0x80) != 0 ? FLAG_NEGATIVE : 0);
+#endif
 }
 
 void CPU6502::bitTest(uint8_t value)
 {
+#ifdef EMUND_CPU_LAZY_FLAGS
+	zeroResult = regA & value;
+	overflowResult = uint8_t(value << 1);
+	negativeResult = value;
+#else
 	regP = (regP & ~(FLAG_ZERO | FLAG_OVERFLOW | FLAG_NEGATIVE)) | ((regA & value) == 0 ? FLAG_ZERO : 0) | (value & (FLAG_OVERFLOW | FLAG_NEGATIVE));
+#endif
 }
 
 void CPU6502::addWithCarry(uint8_t value)
 {
 	const uint8_t a = regA;
-	const uint16_t intermediateResult = static_cast<uint16_t>(a) + static_cast<uint16_t>(value) + static_cast<uint16_t>(regP & FLAG_CARRY);
+	const uint16_t intermediateResult = static_cast<uint16_t>(a) + static_cast<uint16_t>(value) + static_cast<uint16_t>(getCarry());
 	
 	regA = static_cast<uint8_t>(intermediateResult); // Narrow result
 
+#ifdef EMUND_CPU_LAZY_FLAGS
+	carryFlag = uint8_t(intermediateResult >> 8);
+	zeroResult = negativeResult = regA;
+	overflowResult = (a ^ regA) & (value ^ regA);
+#else
 	regP = (regP & ~(FLAG_CARRY | FLAG_ZERO | FLAG_OVERFLOW | FLAG_NEGATIVE))
 		| ((intermediateResult & 0x100) >> 8) // Set carry flag
 		| (regA == 0 ? FLAG_ZERO : 0) // Set zero flag
 		| (((a ^ regA) & (value ^ regA) & 0x80) != 0 ? FLAG_OVERFLOW : 0) // Set overflow flag. See http://www.righto.com/2012/12/the-6502-overflow-flag-explained.html
 		| (regA & 0x80); // Set negative flag
+#endif
 }
 
 void CPU6502::subWithCarry(uint8_t value)
 {
 	const uint8_t a = regA;
-	const uint16_t intermediateResult = static_cast<uint16_t>(a) - static_cast<uint16_t>(value) - static_cast<uint16_t>(~regP & FLAG_CARRY);
+	const uint16_t intermediateResult = static_cast<uint16_t>(a) - static_cast<uint16_t>(value) - static_cast<uint16_t>(getCarry() ^ FLAG_CARRY);
 	
 	regA = static_cast<uint8_t>(intermediateResult); // Narrow result
 
+#ifdef EMUND_CPU_LAZY_FLAGS
+	carryFlag = uint8_t(((intermediateResult >> 8) & 1) ^ FLAG_CARRY);
+	zeroResult = negativeResult = regA;
+	overflowResult = (a ^ regA) & ((255 - value) ^ regA);
+#else
 	regP = (regP & ~(FLAG_CARRY | FLAG_ZERO | FLAG_OVERFLOW | FLAG_NEGATIVE))
 		| (((intermediateResult & 0x100) >> 8) ^ FLAG_CARRY) // Set carry flag
 		| (regA == 0 ? FLAG_ZERO : 0) // Set zero flag
 		| (((a ^ regA) & ((255 - value) ^ regA) & 0x80) != 0 ? FLAG_OVERFLOW : 0) // Set overflow flag. See http://www.righto.com/2012/12/the-6502-overflow-flag-explained.html
 		| (regA & 0x80); // Set negative flag
+#endif
 }
 
 void CPU6502::updateBranchTakenTiming()
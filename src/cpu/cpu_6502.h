@@ -1,13 +1,21 @@
 #pragma once
+#include <array>
 #include <cstdint>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "cpu_6502_disassembler.h"
+#include "cpu_6502_opcodes.h"
 #include "../utils/macros.h"
 
 class AddressSpace8BitBy16Bit;
+class CPU6502JIT;
+class CPU6502PairHistogram;
 
 class CPU6502 {
+	friend class CPU6502JIT;
+
 public:
 	enum class ErrorType {
 		OK,
@@ -15,25 +23,122 @@ public:
 		Break
 	};
 	
+	// Returns the first cycle at which reading the register at address might give something different from what it
+	// has returned to every read since sinceCycle, or 0 if it can't tell
+	using PollHorizonCallback = uint64_t(*)(void*, uint16_t, uint64_t);
+
 	CPU6502();
+	~CPU6502();
 	
 	void setAddressSpace(AddressSpace8BitBy16Bit& addressSpace);
+
+	// Memory that $0000-$01FF always maps to (directly or through mirrors), so that zero page and stack accesses can
+	// skip the address space. Leave unset if those pages can hold anything else.
+	void setDirectRAM(uint8_t* ram);
+	void setPollHorizonCallback(void* data, PollHorizonCallback callback);
+
+	// While set, every instruction gets interpreted on its own and recorded here
+	void setPairHistogram(CPU6502PairHistogram* histogram);
 	void printDebugInfo();
 	void tick();
+	void runUntil(uint64_t targetCycle);
 
 	void raiseIRQ();
 	void raiseNMI();
 	void raiseReset();
 
+	// Level-triggered IRQ input, taken whenever it's asserted and interrupts are enabled
+	void setIRQLine(bool asserted);
+	bool getIRQLine() const;
+
+	// Makes runUntil return after the current instruction, e.g. when an event got scheduled before its deadline
+	void stopRun();
+
+	// Execute breakpoints stop runUntil right before the instruction at their address. While any breakpoint is set
+	// here or in the address space, instructions get interpreted one at a time by tick().
+	void addExecuteBreakpoint(uint16_t address);
+	void clearExecuteBreakpoints();
+
+	// Stops runUntil after the current instruction (e.g. from a bus breakpoint handler), and keeps it from running
+	// again until the hit is cleared
+	void hitBreakpoint();
+	bool hasHitBreakpoint() const;
+	void clearBreakpointHit();
+
 	bool hasError() const;
 	ErrorType getError() const;
 	uint8_t getErrorInstruction() const;
 	uint64_t getCycle() const;
+	uint64_t getInstructionStartCycle() const;
+	uint16_t getPC() const;
+	uint8_t getP() const;
 
-	void copyOAM(uint8_t highAddr, gsl::span<uint8_t> oamData);
+	// Halts the CPU for a number of cycles, e.g. while DMA has the bus
+	void stall(uint32_t cycles);
+
+#ifdef EMUND_CPU_JIT
+	void setJITVerification(bool enabled);
+	size_t getJITVerificationFailures() const;
+#endif
 
 private:
+	using AddressMode = CPU6502AddressMode;
+	using Operation = CPU6502Operation;
+	using OpcodeInfo = CPU6502OpcodeInfo;
+
+	using OpcodeHandler = void (*)(CPU6502& cpu);
+	const static std::array<OpcodeHandler, 256> opcodeHandlers;
+	const static std::array<OpcodeHandler, 256> predecodedOpcodeHandlers;
+
+	struct DecodedInstruction {
+		OpcodeHandler handler = nullptr;
+		OpcodeHandler fusedHandler = nullptr; // Runs this instruction and the next one in one go
+		uint16_t pc = 0;
+		uint16_t operand = 0;
+		uint8_t opcode = 0;
+		uint8_t length = 0;
+		uint8_t maxCycles = 0;
+	};
+
+	struct DecodedBlock {
+		constexpr static size_t maxInstructions = 16;
+
+		uint16_t startPC = 0;
+		uint8_t nInstructions = 0;
+		const uint8_t* page = nullptr;
+		uint32_t pageVersion = 0;
+		std::array<DecodedInstruction, maxInstructions> instructions;
+	};
+
+	constexpr static size_t numDecodedBlocks = 2048;
+
+	// A short loop that only reads memory and jumps back to its start, e.g. polling $2002 or a RAM flag set by the NMI
+	struct IdleLoop {
+		constexpr static size_t maxLength = 16;
+		constexpr static size_t maxReads = 4;
+
+		uint16_t startPC = 0;
+		uint16_t endPC = 0;
+		bool idle = false;
+		const uint8_t* page = nullptr;
+		uint32_t pageVersion = 0;
+		uint8_t baseCycles = 0;
+		uint8_t nReads = 0;
+		std::array<uint16_t, maxReads> reads;
+
+		uint64_t arrivalCycle = 0;
+		uint64_t arrivalInterrupts = 0;
+		uint8_t regA = 0;
+		uint8_t regX = 0;
+		uint8_t regY = 0;
+		uint8_t regS = 0;
+		uint8_t regP = 0;
+	};
+
+	constexpr static size_t numIdleLoops = 16;
+
 	AddressSpace8BitBy16Bit* addressSpace = nullptr;
+	uint8_t* directRAM = nullptr;
 
 	uint8_t regA = 0;
 	uint8_t regX = 0;
@@ -43,16 +148,77 @@ private:
 	uint8_t regP = 0x34;
 	uint64_t cycle = 0;
 
+#ifdef EMUND_CPU_LAZY_FLAGS
+	// C, Z, V and N are kept as whatever they're derived from, and only folded into regP by getP()
+	uint8_t carryFlag = 0;
+	uint8_t zeroResult = 1;
+	uint8_t overflowResult = 0;
+	uint8_t negativeResult = 0;
+#endif
+
 	uint16_t startPC = 0;
+	uint64_t startCycle = 0;
+	bool interrupted = false;
 	bool pageCrossed = false;
+	bool irqLine = false;
+
+	std::vector<DecodedBlock> decodedBlocks;
+	const DecodedBlock* currentBlock = nullptr;
+	size_t currentBlockPosition = 0;
+	uint16_t decodedOperand = 0;
+	uint16_t fusedOperand = 0;
+	uint64_t fusedDeadline = 0;
+
+	std::array<IdleLoop, numIdleLoops> idleLoops;
+	uint64_t interruptCount = 1;
+	void* pollHorizonData = nullptr;
+	PollHorizonCallback pollHorizonCallback = nullptr;
+	CPU6502PairHistogram* pairHistogram = nullptr;
+
+	std::vector<bool> executeBreakpoints;
+	size_t nExecuteBreakpoints = 0;
+	uint32_t resumeBreakpointAddress = noBreakpointAddress; // Lets the instruction we stopped before run on resume
+	bool breakpointHit = false;
+	constexpr static uint32_t noBreakpointAddress = 0x10000;
 	
-	std::unique_ptr<CPU6502Disassembler> disassembler;
+#ifdef EMUND_CPU_JIT
+	std::unique_ptr<CPU6502JIT> jit;
+#endif
 
 	ErrorType error = ErrorType::OK;
 	uint8_t errorInstruction;
 
+	constexpr static const OpcodeInfo& getOpcodeInfo(uint8_t opcode) { return CPU6502Opcodes::get(opcode); }
+	constexpr static bool isZeroPageMode(AddressMode mode) { return mode == AddressMode::ZeroPage || mode == AddressMode::ZeroPageX || mode == AddressMode::ZeroPageY; }
+
+	bool isDebugging() const;
+	void runDebug(uint64_t targetCycle);
+	FORCEINLINE void step(uint64_t targetCycle);
+	void stepInterpreter();
+	void executeReference(uint8_t instruction);
+	template <uint8_t opcode, bool predecoded> void execute();
+	template <uint8_t opcode, bool predecoded> static void executeHandler(CPU6502& cpu);
+	template <bool predecoded, size_t... opcodes> constexpr static std::array<OpcodeHandler, 256> makeOpcodeHandlers(std::index_sequence<opcodes...>);
+	template <uint8_t first, uint8_t second> void executeFused();
+	template <uint8_t first, uint8_t second> static void executeFusedHandler(CPU6502& cpu);
+	template <size_t... indices> constexpr static std::array<OpcodeHandler, sizeof...(indices)> makeFusedHandlers(std::index_sequence<indices...>);
+	static OpcodeHandler getFusedHandler(uint8_t first, uint8_t second);
+
+	const DecodedInstruction* getDecodedInstruction();
+	void decodeBlock(DecodedBlock& block, uint16_t pc);
+	bool isBlockValid(const DecodedBlock& block) const;
+	void fuseInstructions(DecodedBlock& block);
+
+	void checkIdleLoop(uint64_t targetCycle);
+	void analyseIdleLoop(IdleLoop& loop, uint16_t pc);
+	uint16_t getIdleLoopReadAddress(uint16_t pc, bool& pageCrossed) const;
+
+	void setP(uint8_t value);
+	template <uint8_t flag> FORCEINLINE bool isFlagSet() const;
+	FORCEINLINE uint8_t getCarry() const;
 	FORCEINLINE void setZN(uint8_t value);
 	FORCEINLINE void setCarry(uint8_t value);
+	FORCEINLINE void setOverflow(bool value);
 
 	FORCEINLINE uint8_t loadImmediate();
 	FORCEINLINE uint16_t loadImmediate16();
@@ -70,9 +236,20 @@ private:
 	FORCEINLINE uint16_t getAddress(uint8_t mode);
 	FORCEINLINE uint16_t getAddressX(uint8_t mode);
 
+	template <AddressMode mode, bool predecoded> FORCEINLINE uint16_t fetchOperand();
+	template <AddressMode mode, bool pagePenalty, bool predecoded> FORCEINLINE uint16_t getAddress();
+	template <AddressMode mode, bool pagePenalty, bool predecoded> FORCEINLINE uint8_t loadOperand();
+	template <AddressMode mode, bool predecoded> FORCEINLINE void storeOperand(uint8_t value);
+	template <AddressMode mode, bool predecoded, typename F> FORCEINLINE void modifyOperand(F f);
+	template <uint8_t flag, bool set, bool predecoded> FORCEINLINE void branch();
+
 	FORCEINLINE void storeAddressMode(uint8_t value, uint8_t mode);
 	FORCEINLINE void storeAddressModeX(uint8_t value, uint8_t mode);
 
+	FORCEINLINE uint8_t readLowRAM(uint16_t address) const;
+	FORCEINLINE void writeLowRAM(uint16_t address, uint8_t value);
+	bool isDirectRAMPage(uint8_t page) const;
+
 	FORCEINLINE void storeStack(uint8_t value);
 	FORCEINLINE uint8_t loadStack();
 	
@@ -85,4 +262,6 @@ private:
 	FORCEINLINE bool isSamePage(uint16_t addr0, uint16_t addr1);
 
 	FORCEINLINE void startInterrupt(uint16_t address);
+	FORCEINLINE void pollIRQ();
+	FORCEINLINE void enableInterrupts();
 };
@@ -0,0 +1,92 @@
+#include "cpu_6502_histogram.h"
+#include "cpu_6502_opcodes.h"
+
+#include <algorithm>
+#include <halley.hpp>
+using namespace Halley;
+
+namespace {
+	const char* getModeName(CPU6502AddressMode mode)
+	{
+		switch (mode) {
+		case CPU6502AddressMode::Accumulator: return "A";
+		case CPU6502AddressMode::Immediate: return "#imm";
+		case CPU6502AddressMode::ZeroPage: return "zp";
+		case CPU6502AddressMode::ZeroPageX: return "zp,X";
+		case CPU6502AddressMode::ZeroPageY: return "zp,Y";
+		case CPU6502AddressMode::Absolute: return "abs";
+		case CPU6502AddressMode::AbsoluteX: return "abs,X";
+		case CPU6502AddressMode::AbsoluteY: return "abs,Y";
+		case CPU6502AddressMode::Indirect: return "(abs)";
+		case CPU6502AddressMode::IndirectX: return "(zp,X)";
+		case CPU6502AddressMode::IndirectY: return "(zp),Y";
+		case CPU6502AddressMode::Relative: return "rel";
+		default: return "";
+		}
+	}
+
+	String describe(uint8_t opcode)
+	{
+		const auto& info = CPU6502Opcodes::get(opcode);
+		String result = String(info.mnemonic);
+		if (info.mode != CPU6502AddressMode::Implied) {
+			result += " " + String(getModeName(info.mode));
+		}
+		return result;
+	}
+}
+
+CPU6502PairHistogram::CPU6502PairHistogram()
+{
+	counts.resize(256 * 256, 0);
+}
+
+void CPU6502PairHistogram::record(uint8_t opcode)
+{
+	if (hasLastOpcode) {
+		++counts[(size_t(lastOpcode) << 8) | opcode];
+		++total;
+	}
+	lastOpcode = opcode;
+	hasLastOpcode = true;
+}
+
+void CPU6502PairHistogram::clear()
+{
+	std::fill(counts.begin(), counts.end(), 0);
+	total = 0;
+	hasLastOpcode = false;
+}
+
+uint64_t CPU6502PairHistogram::getTotal() const
+{
+	return total;
+}
+
+std::vector<CPU6502PairHistogram::Entry> CPU6502PairHistogram::getTopPairs(size_t n) const
+{
+	std::vector<Entry> result;
+	for (size_t i = 0; i < counts.size(); ++i) {
+		if (counts[i] > 0) {
+			result.push_back(Entry{ uint8_t(i >> 8), uint8_t(i & 0xFF), counts[i] });
+		}
+	}
+
+	n = std::min(n, result.size());
+	std::partial_sort(result.begin(), result.begin() + n, result.end(), [] (const Entry& a, const Entry& b)
+	{
+		return a.count > b.count;
+	});
+	result.resize(n);
+	return result;
+}
+
+void CPU6502PairHistogram::log(size_t n) const
+{
+	Logger::logInfo("Top opcode pairs, out of " + toString(total) + ":");
+	for (const auto& entry: getTopPairs(n)) {
+		const float percentage = total > 0 ? float(entry.count) * 100.0f / float(total) : 0.0f;
+		Logger::logInfo("  $" + toString(int(entry.first), 16, 2).asciiUpper() + " $" + toString(int(entry.second), 16, 2).asciiUpper()
+			+ "  " + describe(entry.first) + " / " + describe(entry.second) + ": " + toString(entry.count) + " (" + toString(percentage, 2) + "%)");
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Counts which opcode follows which, one instruction at a time. Used to pick the instruction pairs worth fusing.
+class CPU6502PairHistogram {
+public:
+	struct Entry {
+		uint8_t first;
+		uint8_t second;
+		uint64_t count;
+	};
+
+	CPU6502PairHistogram();
+
+	void record(uint8_t opcode);
+	void clear();
+
+	uint64_t getTotal() const;
+	std::vector<Entry> getTopPairs(size_t n) const;
+	void log(size_t n) const;
+
+private:
+	std::vector<uint64_t> counts;
+	uint64_t total = 0;
+	uint8_t lastOpcode = 0;
+	bool hasLastOpcode = false;
+};
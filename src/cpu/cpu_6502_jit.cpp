@@ -0,0 +1,1032 @@
+#ifdef EMUND_CPU_JIT
+#include "cpu_6502_jit.h"
+
+#include "address_space.h"
+#include "cpu_6502.h"
+
+#include <halley.hpp>
+using namespace Halley;
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+static_assert(sizeof(void*) == 8, "The 6502 JIT only targets x86-64");
+
+namespace {
+	enum Reg : uint8_t {
+		RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+		R8, R9, R10, R11, R12, R13, R14, R15,
+		NoReg = 0xFF
+	};
+
+#ifdef _WIN32
+	constexpr Reg argReg0 = RCX;
+	constexpr Reg argReg1 = RDX;
+	constexpr Reg argReg2 = R8;
+#else
+	constexpr Reg argReg0 = RDI;
+	constexpr Reg argReg1 = RSI;
+	constexpr Reg argReg2 = RDX;
+#endif
+
+	enum Condition : uint8_t {
+		CondB = 0x2,
+		CondAE = 0x3,
+		CondE = 0x4,
+		CondNE = 0x5
+	};
+
+	// Opcode extensions for the 0x80/0x81 group
+	enum AluOp : uint8_t {
+		AluAdd = 0,
+		AluOr = 1,
+		AluAnd = 4,
+		AluSub = 5,
+		AluXor = 6,
+		AluCmp = 7
+	};
+
+	struct Mem {
+		Reg base;
+		int32_t disp = 0;
+		Reg index = NoReg;
+		uint8_t scale = 1;
+	};
+
+	// Just enough of an x86-64 assembler to emit the code below. Memory operands always use a 32-bit displacement.
+	class X64Emitter {
+	public:
+		std::vector<uint8_t> code;
+
+		void byte(uint8_t value) { code.push_back(value); }
+		void word(uint16_t value) { for (int i = 0; i < 2; ++i) { byte(uint8_t(value >> (i * 8))); } }
+		void dword(uint32_t value) { for (int i = 0; i < 4; ++i) { byte(uint8_t(value >> (i * 8))); } }
+		void qword(uint64_t value) { for (int i = 0; i < 8; ++i) { byte(uint8_t(value >> (i * 8))); } }
+
+		void push(Reg reg) { rexRR(false, 0, reg); byte(0x50 + (reg & 7)); }
+		void pop(Reg reg) { rexRR(false, 0, reg); byte(0x58 + (reg & 7)); }
+		void ret() { byte(0xC3); }
+
+		void subRsp(uint8_t value) { byte(0x48); byte(0x83); byte(0xEC); byte(value); }
+		void addRsp(uint8_t value) { byte(0x48); byte(0x83); byte(0xC4); byte(value); }
+
+		void movImm32(Reg dst, uint32_t value) { rexRR(false, 0, dst); byte(0xB8 + (dst & 7)); dword(value); }
+		void movImm64(Reg dst, uint64_t value) { rexRR(true, 0, dst); byte(0xB8 + (dst & 7)); qword(value); }
+		void movImm64(Reg dst, const void* value) { movImm64(dst, reinterpret_cast<uint64_t>(value)); }
+		void mov64(Reg dst, Reg src) { rexRR(true, src, dst); byte(0x89); modrmRR(src, dst); }
+		void mov32(Reg dst, Reg src) { alu(0x89, dst, src); }
+
+		void load64(Reg dst, Mem m) { rex(true, dst, m); byte(0x8B); modrm(dst, m); }
+		void loadZx8(Reg dst, Mem m) { rex(false, dst, m); byte(0x0F); byte(0xB6); modrm(dst, m); }
+		void zx8(Reg dst, Reg src) { rexRR(false, dst, src, src >= RSP && src <= RDI); byte(0x0F); byte(0xB6); modrmRR(dst, src); }
+		void store8(Mem m, Reg src) { rex(false, src, m, src >= RSP && src <= RDI); byte(0x88); modrm(src, m); }
+		void store8(Mem m, uint8_t value) { rex(false, 0, m); byte(0xC6); modrm(0, m); byte(value); }
+		void store16(Mem m, uint16_t value) { byte(0x66); rex(false, 0, m); byte(0xC7); modrm(0, m); word(value); }
+
+		void add32(Reg dst, Reg src) { alu(0x01, dst, src); }
+		void or32(Reg dst, Reg src) { alu(0x09, dst, src); }
+		void and32(Reg dst, Reg src) { alu(0x21, dst, src); }
+		void sub32(Reg dst, Reg src) { alu(0x29, dst, src); }
+		void xor32(Reg dst, Reg src) { alu(0x31, dst, src); }
+		void cmp32(Reg dst, Reg src) { alu(0x39, dst, src); }
+		void test32(Reg dst, Reg src) { alu(0x85, dst, src); }
+		void alu32(AluOp op, Reg dst, uint32_t value) { rexRR(false, 0, dst); byte(0x81); modrmRR(op, dst); dword(value); }
+		void shl32(Reg dst, uint8_t amount) { rexRR(false, 0, dst); byte(0xC1); modrmRR(4, dst); byte(amount); }
+		void shr32(Reg dst, uint8_t amount) { rexRR(false, 0, dst); byte(0xC1); modrmRR(5, dst); byte(amount); }
+		void setcc(Condition cond, Reg dst) { rexRR(false, 0, dst, dst >= RSP && dst <= RDI); byte(0x0F); byte(0x90 + cond); modrmRR(0, dst); }
+
+		void alu8(AluOp op, Mem m, uint8_t value) { rex(false, 0, m); byte(0x80); modrm(op, m); byte(value); }
+		void test8(Mem m, uint8_t value) { rex(false, 0, m); byte(0xF6); modrm(0, m); byte(value); }
+		void cmp32(Mem m, uint32_t value) { rex(false, 0, m); byte(0x81); modrm(AluCmp, m); dword(value); }
+		void cmp64(Mem m, Reg src) { rex(true, src, m); byte(0x39); modrm(src, m); }
+		void add64(Mem m, uint32_t value) { rex(true, 0, m); byte(0x81); modrm(AluAdd, m); dword(value); }
+		void add64(Mem m, Reg src) { rex(true, src, m); byte(0x01); modrm(src, m); }
+
+		void call(const void* function) { movImm64(RAX, function); byte(0xFF); byte(0xD0); }
+
+		size_t jcc(Condition cond) { byte(0x0F); byte(0x80 + cond); dword(0); return code.size() - 4; }
+		size_t jmp() { byte(0xE9); dword(0); return code.size() - 4; }
+		void bind(size_t patch)
+		{
+			const auto rel = static_cast<uint32_t>(code.size() - (patch + 4));
+			for (int i = 0; i < 4; ++i) {
+				code[patch + i] = uint8_t(rel >> (i * 8));
+			}
+		}
+
+	private:
+		void rex(bool w, uint8_t reg, const Mem& m, bool force = false)
+		{
+			const uint8_t value = 0x40 | (w ? 0x8 : 0) | ((reg & 8) ? 0x4 : 0) | ((m.index != NoReg && (m.index & 8)) ? 0x2 : 0) | ((m.base & 8) ? 0x1 : 0);
+			if (value != 0x40 || force) {
+				byte(value);
+			}
+		}
+
+		void rexRR(bool w, uint8_t reg, uint8_t rm, bool force = false)
+		{
+			const uint8_t value = 0x40 | (w ? 0x8 : 0) | ((reg & 8) ? 0x4 : 0) | ((rm & 8) ? 0x1 : 0);
+			if (value != 0x40 || force) {
+				byte(value);
+			}
+		}
+
+		void modrm(uint8_t reg, const Mem& m)
+		{
+			const bool sib = m.index != NoReg || (m.base & 7) == RSP;
+			byte(0x80 | ((reg & 7) << 3) | (sib ? 0x4 : (m.base & 7)));
+			if (sib) {
+				const uint8_t scaleBits = m.scale == 8 ? 3 : m.scale == 4 ? 2 : m.scale == 2 ? 1 : 0;
+				byte(uint8_t((scaleBits << 6) | (((m.index == NoReg ? RSP : m.index) & 7) << 3) | (m.base & 7)));
+			}
+			dword(static_cast<uint32_t>(m.disp));
+		}
+
+		void modrmRR(uint8_t reg, uint8_t rm)
+		{
+			byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+		}
+
+		void alu(uint8_t opcode, Reg dst, Reg src)
+		{
+			rexRR(false, src, dst);
+			byte(opcode);
+			modrmRR(src, dst);
+		}
+	};
+
+	void writeBus(AddressSpace8BitBy16Bit* addressSpace, uint32_t address, uint32_t value)
+	{
+		addressSpace->write(static_cast<uint16_t>(address), static_cast<uint8_t>(value));
+	}
+
+	template <typename T>
+	int32_t offsetWithin(const CPU6502& cpu, const T& member)
+	{
+		return static_cast<int32_t>(reinterpret_cast<const uint8_t*>(&member) - reinterpret_cast<const uint8_t*>(&cpu));
+	}
+}
+
+CPU6502JIT::CPU6502JIT(CPU6502& cpu, AddressSpace8BitBy16Bit& addressSpace)
+	: cpu(cpu)
+	, addressSpace(addressSpace)
+{
+	offsets.regA = offsetWithin(cpu, cpu.regA);
+	offsets.regX = offsetWithin(cpu, cpu.regX);
+	offsets.regY = offsetWithin(cpu, cpu.regY);
+	offsets.regS = offsetWithin(cpu, cpu.regS);
+	offsets.regP = offsetWithin(cpu, cpu.regP);
+	offsets.regPC = offsetWithin(cpu, cpu.regPC);
+	offsets.startPC = offsetWithin(cpu, cpu.startPC);
+	offsets.cycle = offsetWithin(cpu, cpu.cycle);
+	offsets.decodedOperand = offsetWithin(cpu, cpu.decodedOperand);
+
+	blocks.resize(numBlocks);
+
+#ifdef _WIN32
+	codeBuffer = static_cast<uint8_t*>(VirtualAlloc(nullptr, codeBufferSize, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE));
+#else
+	void* mem = mmap(nullptr, codeBufferSize, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	codeBuffer = mem == MAP_FAILED ? nullptr : static_cast<uint8_t*>(mem);
+#endif
+	if (!codeBuffer) {
+		Logger::logWarning("Unable to allocate executable memory, 6502 JIT disabled");
+	}
+
+#ifdef EMUND_CPU_JIT_VERIFY
+	verification = true;
+#endif
+}
+
+CPU6502JIT::~CPU6502JIT()
+{
+	if (codeBuffer) {
+#ifdef _WIN32
+		VirtualFree(codeBuffer, 0, MEM_RELEASE);
+#else
+		munmap(codeBuffer, codeBufferSize);
+#endif
+	}
+}
+
+bool CPU6502JIT::run(uint64_t targetCycle)
+{
+	const uint16_t pc = cpu.regPC;
+	const uint8_t page = pc >> 8;
+	auto& block = blocks[(pc ^ (pc >> 12)) & (numBlocks - 1)];
+
+	if (block.pc != pc || block.page != addressSpace.getPage(page) || block.pageVersion != addressSpace.getPageVersion(page)) {
+		if (block.code && block.pc == pc && block.page == addressSpace.getPage(page)) {
+			// Same code, but it's been written to since we compiled it
+			selfModifyingPages.insert(block.page);
+		}
+		block = Block();
+		block.pc = pc;
+		block.page = addressSpace.getPage(page);
+		block.pageVersion = addressSpace.getPageVersion(page);
+	}
+
+	if (!block.code) {
+		if (!block.compilable || ++block.hits < hotThreshold) {
+			return false;
+		}
+		compile(block);
+		if (!block.code) {
+			return false;
+		}
+	}
+
+	// Every instruction in the block has to start before the deadline, or an interrupt could land in the middle of it
+	if (cpu.cycle + block.maxCyclesToLastInstruction >= targetCycle) {
+		return false;
+	}
+
+	// Native code keeps all the flags in regP
+	cpu.regP = cpu.getP();
+	if (verification) {
+		runVerified(block);
+	} else {
+		block.code(&cpu);
+	}
+	cpu.setP(cpu.regP);
+	return true;
+}
+
+void CPU6502JIT::flush()
+{
+	for (auto& block: blocks) {
+		block = Block();
+	}
+	codeBufferUsed = 0;
+}
+
+void CPU6502JIT::setVerification(bool enabled)
+{
+	if (verification != enabled) {
+		verification = enabled;
+		flush();
+	}
+}
+
+size_t CPU6502JIT::getVerificationFailures() const
+{
+	return verificationFailures;
+}
+
+void CPU6502JIT::compile(Block& block)
+{
+	block.compilable = false;
+	if (!codeBuffer || selfModifyingPages.count(block.page) != 0 || !isPlainReadPage(block.pc >> 8) || cpu.isDirectRAMPage(block.pc >> 8)) {
+		return;
+	}
+
+	std::array<Instruction, maxInstructions> instructions;
+	const size_t nInstructions = gatherInstructions(block, instructions);
+	if (nInstructions == 0 || (verification && !block.verifiable)) {
+		return;
+	}
+
+	block.maxCyclesToLastInstruction = 0;
+	for (size_t i = 0; i + 1 < nInstructions; ++i) {
+		const auto info = CPU6502::getOpcodeInfo(instructions[i].opcode);
+		block.maxCyclesToLastInstruction += info.baseCycles + (info.pagePenalty ? 1 : 0) + (info.mode == CPU6502::AddressMode::Relative ? 2 : 0);
+	}
+
+	addressSpace.watchWrites(block.pc >> 8);
+	block.pageVersion = addressSpace.getPageVersion(block.pc >> 8);
+	block.code = emit(block, instructions, nInstructions);
+	block.compilable = block.code != nullptr;
+}
+
+size_t CPU6502JIT::gatherInstructions(Block& block, std::array<Instruction, maxInstructions>& instructions) const
+{
+	uint16_t pc = block.pc;
+	size_t n = 0;
+	block.verifiable = true;
+	block.nWrittenPages = 0;
+
+	while (n < maxInstructions) {
+		Instruction instruction;
+		instruction.pc = pc;
+		instruction.opcode = addressSpace.readDirect(pc);
+		const auto info = CPU6502::getOpcodeInfo(instruction.opcode);
+		if ((pc & 0xFF) + info.length > 0x100) {
+			break;
+		}
+		instruction.operand = 0;
+		if (info.length >= 2) {
+			instruction.operand |= addressSpace.readDirect(pc + 1);
+		}
+		if (info.length == 3) {
+			instruction.operand |= uint16_t(addressSpace.readDirect(pc + 2)) << 8;
+		}
+
+		// Anything that might hit a register must start its own block, so the rest of the machine is caught up with it
+		if (!isPlainAccess(instruction)) {
+			if (n > 0) {
+				break;
+			}
+			block.verifiable = false;
+		}
+		if (!addWrittenPages(block, instruction)) {
+			block.verifiable = false;
+		}
+
+		instructions[n++] = instruction;
+		pc += info.length;
+		if (info.blockEnd || (pc & 0xFF) == 0) {
+			break;
+		}
+
+		// A pending IRQ gets taken right after interrupts are enabled, which needs us back out in runUntil
+		if (info.operation == CPU6502::Operation::CLI || info.operation == CPU6502::Operation::PLP) {
+			break;
+		}
+	}
+
+	return n;
+}
+
+bool CPU6502JIT::isPlainPage(uint8_t page) const
+{
+	return addressSpace.masks[page] == 0xFF && addressSpace.isPlainMemory(page);
+}
+
+bool CPU6502JIT::isPlainReadPage(uint8_t page) const
+{
+	return addressSpace.masks[page] == 0xFF && addressSpace.isPlainReadMemory(page);
+}
+
+bool CPU6502JIT::isPlainAccess(const Instruction& instruction) const
+{
+	using Operation = CPU6502::Operation;
+	using AddressMode = CPU6502::AddressMode;
+	const auto info = CPU6502::getOpcodeInfo(instruction.opcode);
+
+	switch (info.operation) {
+	case Operation::Unknown:
+	case Operation::BRK:
+		return false;
+	case Operation::JSR:
+	case Operation::RTS:
+	case Operation::RTI:
+	case Operation::PHA:
+	case Operation::PHP:
+	case Operation::PLA:
+	case Operation::PLP:
+		return isPlainPage(0x01);
+	case Operation::JMP:
+		return info.mode == AddressMode::Absolute || isPlainReadPage(instruction.operand >> 8);
+	default:
+		break;
+	}
+
+	// Reading ROM is fine even though writing it goes to the mapper
+	const bool writes = info.mode != AddressMode::Accumulator && (info.operation == Operation::STA || info.operation == Operation::STX
+		|| info.operation == Operation::STY || info.operation == Operation::SAX || info.operation == Operation::INC || info.operation == Operation::DEC
+		|| info.operation == Operation::ASL || info.operation == Operation::LSR || info.operation == Operation::ROL || info.operation == Operation::ROR);
+	const auto isPlain = [&] (uint8_t page)
+	{
+		return writes ? isPlainPage(page) : isPlainReadPage(page);
+	};
+
+	switch (info.mode) {
+	case AddressMode::ZeroPage:
+	case AddressMode::ZeroPageX:
+	case AddressMode::ZeroPageY:
+		return isPlain(0x00);
+	case AddressMode::Absolute:
+		return isPlain(instruction.operand >> 8);
+	case AddressMode::AbsoluteX:
+	case AddressMode::AbsoluteY:
+		return isPlain(instruction.operand >> 8) && isPlain(uint16_t(instruction.operand + 0xFF) >> 8);
+	case AddressMode::IndirectX:
+	case AddressMode::IndirectY:
+		return false;
+	default:
+		return true;
+	}
+}
+
+bool CPU6502JIT::addWrittenPages(Block& block, const Instruction& instruction) const
+{
+	using Operation = CPU6502::Operation;
+	using AddressMode = CPU6502::AddressMode;
+	const auto info = CPU6502::getOpcodeInfo(instruction.opcode);
+
+	auto addPage = [&] (uint8_t page) -> bool
+	{
+		for (size_t i = 0; i < block.nWrittenPages; ++i) {
+			if (block.writtenPages[i] == page) {
+				return true;
+			}
+		}
+		if (block.nWrittenPages == maxWrittenPages) {
+			return false;
+		}
+		block.writtenPages[block.nWrittenPages++] = page;
+		return true;
+	};
+
+	switch (info.operation) {
+	case Operation::PHA:
+	case Operation::PHP:
+	case Operation::JSR:
+	case Operation::BRK:
+		return addPage(0x01);
+	case Operation::STA:
+	case Operation::STX:
+	case Operation::STY:
+	case Operation::SAX:
+	case Operation::INC:
+	case Operation::DEC:
+	case Operation::ASL:
+	case Operation::LSR:
+	case Operation::ROL:
+	case Operation::ROR:
+		break;
+	default:
+		return true;
+	}
+
+	switch (info.mode) {
+	case AddressMode::Accumulator:
+		return true;
+	case AddressMode::ZeroPage:
+	case AddressMode::ZeroPageX:
+	case AddressMode::ZeroPageY:
+		return addPage(0x00);
+	case AddressMode::Absolute:
+		return addPage(instruction.operand >> 8);
+	case AddressMode::AbsoluteX:
+	case AddressMode::AbsoluteY:
+		return addPage(instruction.operand >> 8) && addPage(uint16_t(instruction.operand + 0xFF) >> 8);
+	default:
+		return false;
+	}
+}
+
+CPU6502JIT::NativeBlock CPU6502JIT::emit(const Block& block, const std::array<Instruction, maxInstructions>& instructions, size_t nInstructions)
+{
+	using Operation = CPU6502::Operation;
+	using AddressMode = CPU6502::AddressMode;
+
+	// rbx holds the CPU for the whole block, rax/rcx/rdx/r8/r9 are scratch. 6502 registers live in the CPU object.
+	X64Emitter e;
+	const auto cpuMem = [] (int32_t offset) { return Mem{ RBX, offset }; };
+	const auto regA = cpuMem(offsets.regA);
+	const auto regX = cpuMem(offsets.regX);
+	const auto regY = cpuMem(offsets.regY);
+	const auto regS = cpuMem(offsets.regS);
+	const auto regP = cpuMem(offsets.regP);
+	const auto regPC = cpuMem(offsets.regPC);
+	const auto cycle = cpuMem(offsets.cycle);
+
+	uint32_t pendingCycles = 0;
+	std::vector<size_t> exitPatches;
+
+	const auto flushCycles = [&] ()
+	{
+		if (pendingCycles > 0) {
+			e.add64(cycle, pendingCycles);
+			pendingCycles = 0;
+		}
+	};
+
+	const auto emitEpilogue = [&] ()
+	{
+		e.addRsp(32);
+		e.pop(RBX);
+		e.ret();
+	};
+
+	const auto emitExit = [&] (uint16_t pc, uint32_t cycles)
+	{
+		e.store16(regPC, pc);
+		if (cycles > 0) {
+			e.add64(cycle, cycles);
+		}
+		emitEpilogue();
+	};
+
+	// P = (P & ~clearMask) | extraFlags(ecx) | Z/N from eax
+	const auto emitSetFlags = [&] (uint8_t clearMask, bool useExtra)
+	{
+		e.loadZx8(RDX, regP);
+		e.alu32(AluAnd, RDX, uint8_t(~(clearMask | 0x82)));
+		if (useExtra) {
+			e.or32(RDX, RCX);
+		}
+		e.mov32(R8, RAX);
+		e.alu32(AluAnd, R8, 0x80);
+		e.or32(RDX, R8);
+		e.test32(RAX, RAX);
+		e.setcc(CondE, R8);
+		e.zx8(R8, R8);
+		e.shl32(R8, 1);
+		e.or32(RDX, R8);
+		e.store8(regP, RDX);
+	};
+
+	const auto emitLoadPage = [&] (Reg dst, uint8_t page)
+	{
+		e.movImm64(dst, &addressSpace.memory[page]);
+		e.load64(dst, Mem{ dst });
+	};
+
+	// Leaves the effective address in eax, for the modes that need computing at runtime
+	const auto emitIndexedAddress = [&] (const Instruction& instruction, const CPU6502::OpcodeInfo& info)
+	{
+		const bool indexX = info.mode == AddressMode::ZeroPageX || info.mode == AddressMode::AbsoluteX;
+		e.loadZx8(RAX, indexX ? regX : regY);
+		e.alu32(AluAdd, RAX, instruction.operand);
+		if (info.mode == AddressMode::ZeroPageX || info.mode == AddressMode::ZeroPageY) {
+			e.alu32(AluAnd, RAX, 0xFF);
+		} else {
+			e.alu32(AluAnd, RAX, 0xFFFF);
+			if (info.pagePenalty) {
+				e.mov32(RCX, RAX);
+				e.shr32(RCX, 8);
+				e.alu32(AluCmp, RCX, instruction.operand >> 8);
+				e.setcc(CondNE, RCX);
+				e.zx8(RCX, RCX);
+				e.add64(cycle, RCX);
+			}
+		}
+	};
+
+	const auto isIndexed = [] (AddressMode mode)
+	{
+		return mode == AddressMode::ZeroPageX || mode == AddressMode::ZeroPageY || mode == AddressMode::AbsoluteX || mode == AddressMode::AbsoluteY;
+	};
+
+	// Loads the operand into eax
+	const auto emitLoadOperand = [&] (const Instruction& instruction, const CPU6502::OpcodeInfo& info)
+	{
+		if (info.mode == AddressMode::Immediate) {
+			e.movImm32(RAX, instruction.operand & 0xFF);
+		} else if (isIndexed(info.mode)) {
+			emitIndexedAddress(instruction, info);
+			e.mov32(RCX, RAX);
+			e.shr32(RCX, 8);
+			e.movImm64(RDX, &addressSpace.memory[0]);
+			e.load64(RDX, Mem{ RDX, 0, RCX, 8 });
+			e.alu32(AluAnd, RAX, 0xFF);
+			e.loadZx8(RAX, Mem{ RDX, 0, RAX, 1 });
+		} else {
+			emitLoadPage(RDX, instruction.operand >> 8);
+			e.loadZx8(RAX, Mem{ RDX, int32_t(instruction.operand & 0xFF) });
+		}
+	};
+
+	// Stores r9b. Pages holding code go through the address space so it can invalidate them, and then bail out
+	const auto emitStoreOperand = [&] (const Instruction& instruction, const CPU6502::OpcodeInfo& info, uint16_t nextPC)
+	{
+		if (isIndexed(info.mode)) {
+			emitIndexedAddress(instruction, info);
+		} else {
+			e.movImm32(RAX, instruction.operand);
+		}
+		e.mov32(RCX, RAX);
+		e.shr32(RCX, 8);
+		e.movImm64(RDX, &addressSpace.pageFlags[0]);
+		e.test8(Mem{ RDX, 0, RCX, 1 }, AddressSpace8BitBy16Bit::PageWriteRegisters | AddressSpace8BitBy16Bit::PageWriteBreakpoints | AddressSpace8BitBy16Bit::PageWatched);
+		const auto slowPath = e.jcc(CondNE);
+
+#ifdef EMUND_DIRTY_PAGES
+		e.movImm64(RDX, &addressSpace.dirtyPages[0]);
+		e.movImm32(R8, 1);
+		e.store8(Mem{ RDX, 0, RCX, 1 }, R8);
+#endif
+		e.movImm64(RDX, &addressSpace.memory[0]);
+		e.load64(RDX, Mem{ RDX, 0, RCX, 8 });
+		e.mov32(R8, RAX);
+		e.alu32(AluAnd, R8, 0xFF);
+		e.store8(Mem{ RDX, 0, R8, 1 }, R9);
+		const auto done = e.jmp();
+
+		e.bind(slowPath);
+		e.mov32(argReg1, RAX);
+		e.mov32(argReg2, R9);
+		e.movImm64(argReg0, &addressSpace);
+		e.call(reinterpret_cast<const void*>(&writeBus));
+		emitExit(nextPC, pendingCycles);
+
+		e.bind(done);
+	};
+
+	const auto isNative = [&] (const Instruction& instruction, const CPU6502::OpcodeInfo& info)
+	{
+		if (!isPlainAccess(instruction)) {
+			return false;
+		}
+		switch (info.operation) {
+		case Operation::ASL:
+		case Operation::LSR:
+			return info.mode == AddressMode::Accumulator;
+		case Operation::JMP:
+			return info.mode == AddressMode::Absolute;
+		case Operation::LDA: case Operation::LDX: case Operation::LDY: case Operation::LAX:
+		case Operation::STA: case Operation::STX: case Operation::STY: case Operation::SAX:
+		case Operation::AND: case Operation::ORA: case Operation::EOR: case Operation::ADC: case Operation::SBC:
+		case Operation::CMP: case Operation::CPX: case Operation::CPY: case Operation::BIT:
+		case Operation::INC: case Operation::DEC: case Operation::NOP:
+		case Operation::INX: case Operation::INY: case Operation::DEX: case Operation::DEY:
+		case Operation::TAX: case Operation::TAY: case Operation::TXA: case Operation::TYA: case Operation::TSX: case Operation::TXS:
+		case Operation::CLC: case Operation::SEC: case Operation::CLI: case Operation::SEI: case Operation::CLD: case Operation::SED: case Operation::CLV:
+		case Operation::BCC: case Operation::BCS: case Operation::BEQ: case Operation::BNE:
+		case Operation::BMI: case Operation::BPL: case Operation::BVC: case Operation::BVS:
+			return true;
+		default:
+			return false;
+		}
+	};
+
+	// Prologue. Keeps the stack 16-byte aligned and reserves the shadow space Win64 wants.
+	e.push(RBX);
+	e.subRsp(32);
+	e.mov64(RBX, argReg0);
+
+	const uint8_t page = block.pc >> 8;
+	bool exited = false;
+
+	for (size_t i = 0; i < nInstructions; ++i) {
+		const auto& instruction = instructions[i];
+		const auto info = CPU6502::getOpcodeInfo(instruction.opcode);
+		const uint16_t nextPC = instruction.pc + info.length;
+		const bool last = i == nInstructions - 1;
+
+		if (!isNative(instruction, info)) {
+			// Let the interpreter deal with it
+			flushCycles();
+			e.store16(cpuMem(offsets.startPC), instruction.pc);
+			e.store16(regPC, nextPC);
+			e.store16(cpuMem(offsets.decodedOperand), instruction.operand);
+			e.mov64(argReg0, RBX);
+#ifdef EMUND_CPU_LAZY_FLAGS
+			e.movImm64(argReg1, reinterpret_cast<const void*>(CPU6502::predecodedOpcodeHandlers[instruction.opcode]));
+			e.call(reinterpret_cast<const void*>(&CPU6502JIT::callHandlerWithLazyFlags));
+#else
+			e.call(reinterpret_cast<const void*>(CPU6502::predecodedOpcodeHandlers[instruction.opcode]));
+#endif
+
+			if (info.blockEnd) {
+				emitEpilogue();
+				exited = true;
+				break;
+			}
+			if (!last) {
+				// It might have remapped or written over this block
+				e.movImm64(RDX, &addressSpace.memory[page]);
+				e.movImm64(RAX, block.page);
+				e.cmp64(Mem{ RDX }, RAX);
+				exitPatches.push_back(e.jcc(CondNE));
+				e.movImm64(RDX, &addressSpace.pageVersions[page]);
+				e.cmp32(Mem{ RDX }, block.pageVersion);
+				exitPatches.push_back(e.jcc(CondNE));
+			}
+			continue;
+		}
+
+		pendingCycles += info.baseCycles;
+
+		switch (info.operation) {
+		case Operation::LDA:
+		case Operation::LDX:
+		case Operation::LDY:
+		case Operation::LAX:
+			emitLoadOperand(instruction, info);
+			if (info.operation != Operation::LDY) {
+				e.store8(info.operation == Operation::LDX ? regX : regA, RAX);
+			}
+			if (info.operation == Operation::LAX) {
+				e.store8(regX, RAX);
+			}
+			if (info.operation == Operation::LDY) {
+				e.store8(regY, RAX);
+			}
+			emitSetFlags(0, false);
+			break;
+
+		case Operation::STA:
+		case Operation::STX:
+		case Operation::STY:
+		case Operation::SAX:
+			e.loadZx8(R9, info.operation == Operation::STX ? regX : info.operation == Operation::STY ? regY : regA);
+			if (info.operation == Operation::SAX) {
+				e.loadZx8(RCX, regX);
+				e.and32(R9, RCX);
+			}
+			emitStoreOperand(instruction, info, nextPC);
+			break;
+
+		case Operation::AND:
+		case Operation::ORA:
+		case Operation::EOR:
+			emitLoadOperand(instruction, info);
+			e.loadZx8(RCX, regA);
+			if (info.operation == Operation::AND) {
+				e.and32(RAX, RCX);
+			} else if (info.operation == Operation::ORA) {
+				e.or32(RAX, RCX);
+			} else {
+				e.xor32(RAX, RCX);
+			}
+			e.store8(regA, RAX);
+			emitSetFlags(0, false);
+			break;
+
+		case Operation::ADC:
+		case Operation::SBC:
+			// SBC is ADC of the inverted operand
+			emitLoadOperand(instruction, info);
+			if (info.operation == Operation::SBC) {
+				e.alu32(AluXor, RAX, 0xFF);
+			}
+			e.loadZx8(RCX, regA);
+			e.loadZx8(R9, regP);
+			e.alu32(AluAnd, R9, 0x01);
+			e.add32(R9, RCX);
+			e.add32(R9, RAX);
+			e.xor32(RCX, R9);
+			e.xor32(RAX, R9);
+			e.and32(RCX, RAX);
+			e.alu32(AluAnd, RCX, 0x80);
+			e.shr32(RCX, 1);
+			e.mov32(RAX, R9);
+			e.shr32(RAX, 8);
+			e.or32(RCX, RAX);
+			e.mov32(RAX, R9);
+			e.alu32(AluAnd, RAX, 0xFF);
+			e.store8(regA, RAX);
+			emitSetFlags(0x41, true);
+			break;
+
+		case Operation::CMP:
+		case Operation::CPX:
+		case Operation::CPY:
+			emitLoadOperand(instruction, info);
+			e.loadZx8(RCX, info.operation == Operation::CPX ? regX : info.operation == Operation::CPY ? regY : regA);
+			e.mov32(R9, RCX);
+			e.sub32(R9, RAX);
+			e.cmp32(RCX, RAX);
+			e.setcc(CondAE, RCX);
+			e.zx8(RCX, RCX);
+			e.mov32(RAX, R9);
+			e.alu32(AluAnd, RAX, 0xFF);
+			emitSetFlags(0x01, true);
+			break;
+
+		case Operation::BIT:
+			emitLoadOperand(instruction, info);
+			e.loadZx8(RDX, regP);
+			e.alu32(AluAnd, RDX, 0x3D);
+			e.mov32(R8, RAX);
+			e.alu32(AluAnd, R8, 0xC0);
+			e.or32(RDX, R8);
+			e.loadZx8(RCX, regA);
+			e.test32(RCX, RAX);
+			e.setcc(CondE, R8);
+			e.zx8(R8, R8);
+			e.shl32(R8, 1);
+			e.or32(RDX, R8);
+			e.store8(regP, RDX);
+			break;
+
+		case Operation::INC:
+		case Operation::DEC:
+			emitLoadOperand(instruction, info);
+			e.alu32(info.operation == Operation::INC ? AluAdd : AluSub, RAX, 1);
+			e.alu32(AluAnd, RAX, 0xFF);
+			e.mov32(R9, RAX);
+			emitSetFlags(0, false);
+			emitStoreOperand(instruction, info, nextPC);
+			break;
+
+		case Operation::ASL:
+		case Operation::LSR:
+			e.loadZx8(RAX, regA);
+			e.mov32(RCX, RAX);
+			if (info.operation == Operation::ASL) {
+				e.shr32(RCX, 7);
+				e.shl32(RAX, 1);
+				e.alu32(AluAnd, RAX, 0xFF);
+			} else {
+				e.alu32(AluAnd, RCX, 0x01);
+				e.shr32(RAX, 1);
+			}
+			e.store8(regA, RAX);
+			emitSetFlags(0x01, true);
+			break;
+
+		case Operation::NOP:
+			// Only plain memory gets here, so skipping the read has no visible effect, but its timing still does
+			if (isIndexed(info.mode) && info.pagePenalty) {
+				emitIndexedAddress(instruction, info);
+			}
+			break;
+
+		case Operation::INX:
+		case Operation::INY:
+		case Operation::DEX:
+		case Operation::DEY:
+			{
+				const auto reg = info.operation == Operation::INX || info.operation == Operation::DEX ? regX : regY;
+				e.loadZx8(RAX, reg);
+				e.alu32(info.operation == Operation::INX || info.operation == Operation::INY ? AluAdd : AluSub, RAX, 1);
+				e.alu32(AluAnd, RAX, 0xFF);
+				e.store8(reg, RAX);
+				emitSetFlags(0, false);
+				break;
+			}
+
+		case Operation::TAX:
+		case Operation::TAY:
+		case Operation::TXA:
+		case Operation::TYA:
+		case Operation::TSX:
+			{
+				const auto src = info.operation == Operation::TXA ? regX : info.operation == Operation::TYA ? regY : info.operation == Operation::TSX ? regS : regA;
+				const auto dst = info.operation == Operation::TAX || info.operation == Operation::TSX ? regX : info.operation == Operation::TAY ? regY : regA;
+				e.loadZx8(RAX, src);
+				e.store8(dst, RAX);
+				emitSetFlags(0, false);
+				break;
+			}
+
+		case Operation::TXS:
+			e.loadZx8(RAX, regX);
+			e.store8(regS, RAX);
+			break;
+
+		case Operation::CLC: e.alu8(AluAnd, regP, uint8_t(~0x01)); break;
+		case Operation::SEC: e.alu8(AluOr, regP, 0x01); break;
+		case Operation::CLI: e.alu8(AluAnd, regP, uint8_t(~0x04)); break;
+		case Operation::SEI: e.alu8(AluOr, regP, 0x04); break;
+		case Operation::CLD: e.alu8(AluAnd, regP, uint8_t(~0x08)); break;
+		case Operation::SED: e.alu8(AluOr, regP, 0x08); break;
+		case Operation::CLV: e.alu8(AluAnd, regP, uint8_t(~0x40)); break;
+
+		case Operation::JMP:
+			emitExit(instruction.operand, pendingCycles);
+			exited = true;
+			break;
+
+		case Operation::BCC: case Operation::BCS: case Operation::BEQ: case Operation::BNE:
+		case Operation::BMI: case Operation::BPL: case Operation::BVC: case Operation::BVS:
+			{
+				const Operation op = info.operation;
+				const uint8_t flag = op == Operation::BCC || op == Operation::BCS ? 0x01
+					: op == Operation::BEQ || op == Operation::BNE ? 0x02
+					: op == Operation::BVC || op == Operation::BVS ? 0x40
+					: 0x80;
+				const bool takenIfSet = op == Operation::BCS || op == Operation::BEQ || op == Operation::BMI || op == Operation::BVS;
+				const uint16_t target = nextPC + static_cast<int8_t>(instruction.operand & 0xFF);
+				const uint32_t takenCycles = (target & 0xFF00) == (nextPC & 0xFF00) ? 1 : 2;
+
+				e.test8(regP, flag);
+				const auto taken = e.jcc(takenIfSet ? CondNE : CondE);
+				emitExit(nextPC, pendingCycles);
+				e.bind(taken);
+				emitExit(target, pendingCycles + takenCycles);
+				exited = true;
+				break;
+			}
+
+		default:
+			break;
+		}
+
+		if (exited) {
+			break;
+		}
+	}
+
+	if (!exited) {
+		const auto& lastInstruction = instructions[nInstructions - 1];
+		emitExit(lastInstruction.pc + CPU6502::getOpcodeInfo(lastInstruction.opcode).length, pendingCycles);
+	}
+
+	// Early exits after an interpreted instruction, which already left PC and cycles up to date
+	if (!exitPatches.empty()) {
+		for (const auto patch: exitPatches) {
+			e.bind(patch);
+		}
+		emitEpilogue();
+	}
+
+	if (codeBufferUsed + e.code.size() > codeBufferSize) {
+		flush();
+		return nullptr;
+	}
+	auto* dst = codeBuffer + codeBufferUsed;
+	memcpy(dst, e.code.data(), e.code.size());
+	codeBufferUsed += (e.code.size() + 15) & ~size_t(15);
+	return reinterpret_cast<NativeBlock>(dst);
+}
+
+#ifdef EMUND_CPU_LAZY_FLAGS
+void CPU6502JIT::callHandlerWithLazyFlags(CPU6502* cpu, void (*handler)(CPU6502& cpu))
+{
+	cpu->setP(cpu->regP);
+	handler(*cpu);
+	cpu->regP = cpu->getP();
+}
+#endif
+
+void CPU6502JIT::runVerified(const Block& block)
+{
+	// Runs the block natively, then rewinds and replays it through the interpreter, and compares the results.
+	// Only blocks that stay clear of registers get here, so replaying them has no side effects beyond the memory restored here.
+	struct State {
+		uint8_t regA;
+		uint8_t regX;
+		uint8_t regY;
+		uint8_t regS;
+		uint8_t regP;
+		uint16_t regPC;
+		uint64_t cycle;
+		CPU6502::ErrorType error;
+
+		bool operator==(const State& other) const
+		{
+			return regA == other.regA && regX == other.regX && regY == other.regY && regS == other.regS && regP == other.regP
+				&& regPC == other.regPC && cycle == other.cycle && error == other.error;
+		}
+	};
+
+	const auto saveState = [&] ()
+	{
+		return State{ cpu.regA, cpu.regX, cpu.regY, cpu.regS, cpu.regP, cpu.regPC, cpu.cycle, cpu.error };
+	};
+	const auto loadState = [&] (const State& state)
+	{
+		cpu.regA = state.regA;
+		cpu.regX = state.regX;
+		cpu.regY = state.regY;
+		cpu.regS = state.regS;
+		cpu.regP = state.regP;
+		cpu.regPC = state.regPC;
+		cpu.cycle = state.cycle;
+		cpu.error = state.error;
+	};
+
+	using PageData = std::array<uint8_t, 256>;
+	std::array<PageData, maxWrittenPages> initialMemory;
+	std::array<PageData, maxWrittenPages> nativeMemory;
+	const auto savePages = [&] (std::array<PageData, maxWrittenPages>& dst)
+	{
+		for (size_t i = 0; i < block.nWrittenPages; ++i) {
+			memcpy(dst[i].data(), addressSpace.memory[block.writtenPages[i]], 256);
+		}
+	};
+	const auto loadPages = [&] (const std::array<PageData, maxWrittenPages>& src)
+	{
+		for (size_t i = 0; i < block.nWrittenPages; ++i) {
+			memcpy(addressSpace.memory[block.writtenPages[i]], src[i].data(), 256);
+		}
+	};
+
+	const auto initialState = saveState();
+	savePages(initialMemory);
+
+	block.code(&cpu);
+	const auto nativeState = saveState();
+	savePages(nativeMemory);
+
+	loadState(initialState);
+	loadPages(initialMemory);
+	cpu.setP(cpu.regP);
+
+	// Native code can leave early, so stop the interpreter at the same point
+	for (size_t i = 0; i < maxInstructions && !(cpu.regPC == nativeState.regPC && cpu.cycle == nativeState.cycle); ++i) {
+		cpu.startPC = cpu.regPC;
+		cpu.stepInterpreter();
+		if (cpu.hasError() || (cpu.regPC >> 8) != (block.pc >> 8)) {
+			break;
+		}
+	}
+
+	cpu.regP = cpu.getP();
+
+	bool memoryMatches = true;
+	for (size_t i = 0; i < block.nWrittenPages; ++i) {
+		memoryMatches = memoryMatches && memcmp(addressSpace.memory[block.writtenPages[i]], nativeMemory[i].data(), 256) == 0;
+	}
+
+	const auto interpretedState = saveState();
+	if (!(interpretedState == nativeState) || !memoryMatches) {
+		++verificationFailures;
+		Logger::logError("JIT mismatch on block at $" + toString(block.pc, 16, 4).asciiUpper()
+			+ ": native PC=$" + toString(nativeState.regPC, 16, 4).asciiUpper() + " P=$" + toString(uint32_t(nativeState.regP), 16, 2).asciiUpper() + " CYC:" + toString(nativeState.cycle)
+			+ ", interpreted PC=$" + toString(interpretedState.regPC, 16, 4).asciiUpper() + " P=$" + toString(uint32_t(interpretedState.regP), 16, 2).asciiUpper() + " CYC:" + toString(interpretedState.cycle)
+			+ (memoryMatches ? "" : ", memory differs"));
+	}
+}
+
+#endif
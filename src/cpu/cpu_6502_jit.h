@@ -0,0 +1,93 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+class CPU6502;
+class AddressSpace8BitBy16Bit;
+
+// Translates hot blocks of 6502 code into x86-64.
+// Blocks only ever touch memory-mapped registers on their first instruction, so they can be run in one go without
+// upsetting the PPU/APU interleaving done by the machine. Anything that isn't translated natively calls back into
+// the interpreter's handlers.
+class CPU6502JIT {
+public:
+	CPU6502JIT(CPU6502& cpu, AddressSpace8BitBy16Bit& addressSpace);
+	~CPU6502JIT();
+
+	bool run(uint64_t targetCycle);
+	void flush();
+
+	void setVerification(bool enabled);
+	size_t getVerificationFailures() const;
+
+private:
+	using NativeBlock = void(*)(CPU6502* cpu);
+
+	constexpr static size_t numBlocks = 4096;
+	constexpr static size_t maxInstructions = 32;
+	constexpr static size_t maxWrittenPages = 8;
+	constexpr static size_t codeBufferSize = 16 * 1024 * 1024;
+	constexpr static uint16_t hotThreshold = 8;
+
+	struct Instruction {
+		uint16_t pc;
+		uint16_t operand;
+		uint8_t opcode;
+	};
+
+	struct Block {
+		uint16_t pc = 0;
+		uint16_t hits = 0;
+		bool compilable = true;
+		bool verifiable = false;
+		const uint8_t* page = nullptr;
+		uint32_t pageVersion = 0;
+		NativeBlock code = nullptr;
+		uint16_t maxCyclesToLastInstruction = 0;
+
+		uint8_t nWrittenPages = 0;
+		std::array<uint8_t, maxWrittenPages> writtenPages;
+	};
+
+	struct Offsets {
+		int32_t regA;
+		int32_t regX;
+		int32_t regY;
+		int32_t regS;
+		int32_t regP;
+		int32_t regPC;
+		int32_t startPC;
+		int32_t cycle;
+		int32_t decodedOperand;
+	};
+
+	CPU6502& cpu;
+	AddressSpace8BitBy16Bit& addressSpace;
+	Offsets offsets;
+
+	std::vector<Block> blocks;
+	std::unordered_set<const uint8_t*> selfModifyingPages;
+
+	uint8_t* codeBuffer = nullptr;
+	size_t codeBufferUsed = 0;
+
+	bool verification = false;
+	size_t verificationFailures = 0;
+
+	void compile(Block& block);
+	size_t gatherInstructions(Block& block, std::array<Instruction, maxInstructions>& instructions) const;
+	bool isPlainPage(uint8_t page) const;
+	bool isPlainReadPage(uint8_t page) const;
+	bool isPlainAccess(const Instruction& instruction) const;
+	bool addWrittenPages(Block& block, const Instruction& instruction) const;
+	NativeBlock emit(const Block& block, const std::array<Instruction, maxInstructions>& instructions, size_t nInstructions);
+
+	void runVerified(const Block& block);
+
+#ifdef EMUND_CPU_LAZY_FLAGS
+	// Handlers keep the flags lazily, so they get unpacked from regP around each call out of native code
+	static void callHandlerWithLazyFlags(CPU6502* cpu, void (*handler)(CPU6502& cpu));
+#endif
+};
@@ -0,0 +1,330 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+enum class CPU6502AddressMode : uint8_t {
+	Implied,
+	Accumulator,
+	Immediate,
+	ZeroPage,
+	ZeroPageX,
+	ZeroPageY,
+	Absolute,
+	AbsoluteX,
+	AbsoluteY,
+	Indirect,
+	IndirectX,
+	IndirectY,
+	Relative
+};
+
+enum class CPU6502Operation : uint8_t {
+	Unknown,
+	ADC, AND, ASL, BCC, BCS, BEQ, BIT, BMI, BNE, BPL, BRK, BVC, BVS, CLC,
+	CLD, CLI, CLV, CMP, CPX, CPY, DEC, DEX, DEY, EOR, INC, INX, INY, JMP,
+	JSR, LDA, LDX, LDY, LSR, NOP, ORA, PHA, PHP, PLA, PLP, ROL, ROR, RTI,
+	RTS, SBC, SEC, SED, SEI, STA, STX, STY, TAX, TAY, TSX, TXA, TXS, TYA,
+	LAX, SAX
+};
+
+// Everything the CPU, the block decoders and the disassembler need to know about an opcode.
+// Timing: baseCycles, plus one if pagePenalty and indexing crosses a page. Branches (mode == Relative)
+// take one more cycle when taken, and another if the target is on a different page.
+struct CPU6502OpcodeInfo {
+	CPU6502Operation operation = CPU6502Operation::Unknown;
+	CPU6502AddressMode mode = CPU6502AddressMode::Implied;
+	const char* mnemonic = "???";
+	uint8_t length = 1;
+	uint8_t baseCycles = 0;
+	bool pagePenalty = false;
+	bool official = false;
+	bool blockEnd = true;
+};
+
+class CPU6502Opcodes {
+public:
+	constexpr static const CPU6502OpcodeInfo& get(uint8_t opcode);
+
+	constexpr static const char* getMnemonic(CPU6502Operation operation);
+	constexpr static uint8_t getLength(CPU6502AddressMode mode);
+	constexpr static bool isBlockEnd(CPU6502Operation operation);
+
+private:
+	enum Flags : uint8_t {
+		None = 0,
+		PagePenalty = 1,
+		Unofficial = 2
+	};
+
+	constexpr static std::array<CPU6502OpcodeInfo, 256> makeTable();
+	const static std::array<CPU6502OpcodeInfo, 256> table;
+};
+
+constexpr const char* CPU6502Opcodes::getMnemonic(CPU6502Operation operation)
+{
+	constexpr const char* names[] = {
+		"???",
+		"ADC", "AND", "ASL", "BCC", "BCS", "BEQ", "BIT", "BMI", "BNE", "BPL", "BRK", "BVC", "BVS", "CLC",
+		"CLD", "CLI", "CLV", "CMP", "CPX", "CPY", "DEC", "DEX", "DEY", "EOR", "INC", "INX", "INY", "JMP",
+		"JSR", "LDA", "LDX", "LDY", "LSR", "NOP", "ORA", "PHA", "PHP", "PLA", "PLP", "ROL", "ROR", "RTI",
+		"RTS", "SBC", "SEC", "SED", "SEI", "STA", "STX", "STY", "TAX", "TAY", "TSX", "TXA", "TXS", "TYA",
+		"LAX", "SAX"
+	};
+	return names[static_cast<size_t>(operation)];
+}
+
+constexpr uint8_t CPU6502Opcodes::getLength(CPU6502AddressMode mode)
+{
+	switch (mode) {
+	case CPU6502AddressMode::Implied:
+	case CPU6502AddressMode::Accumulator:
+		return 1;
+	case CPU6502AddressMode::Absolute:
+	case CPU6502AddressMode::AbsoluteX:
+	case CPU6502AddressMode::AbsoluteY:
+	case CPU6502AddressMode::Indirect:
+		return 3;
+	default:
+		return 2;
+	}
+}
+
+constexpr bool CPU6502Opcodes::isBlockEnd(CPU6502Operation operation)
+{
+	switch (operation) {
+	case CPU6502Operation::BCC:
+	case CPU6502Operation::BCS:
+	case CPU6502Operation::BEQ:
+	case CPU6502Operation::BMI:
+	case CPU6502Operation::BNE:
+	case CPU6502Operation::BPL:
+	case CPU6502Operation::BVC:
+	case CPU6502Operation::BVS:
+	case CPU6502Operation::BRK:
+	case CPU6502Operation::JMP:
+	case CPU6502Operation::JSR:
+	case CPU6502Operation::RTI:
+	case CPU6502Operation::RTS:
+	case CPU6502Operation::Unknown:
+		return true;
+	default:
+		return false;
+	}
+}
+
+constexpr std::array<CPU6502OpcodeInfo, 256> CPU6502Opcodes::makeTable()
+{
+	using Op = CPU6502Operation;
+	using Mode = CPU6502AddressMode;
+
+	std::array<CPU6502OpcodeInfo, 256> result = {};
+	auto set = [&] (uint8_t opcode, Op operation, Mode mode, uint8_t cycles, uint8_t flags = None)
+	{
+		auto& info = result[opcode];
+		info.operation = operation;
+		info.mode = mode;
+		info.mnemonic = getMnemonic(operation);
+		info.length = getLength(mode);
+		info.baseCycles = cycles;
+		info.pagePenalty = (flags & PagePenalty) != 0;
+		info.official = (flags & Unofficial) == 0;
+		info.blockEnd = isBlockEnd(operation);
+	};
+
+	set(0x69, Op::ADC, Mode::Immediate,   2);
+	set(0x65, Op::ADC, Mode::ZeroPage,    3);
+	set(0x75, Op::ADC, Mode::ZeroPageX,   4);
+	set(0x6D, Op::ADC, Mode::Absolute,    4);
+	set(0x7D, Op::ADC, Mode::AbsoluteX,   4, PagePenalty);
+	set(0x79, Op::ADC, Mode::AbsoluteY,   4, PagePenalty);
+	set(0x61, Op::ADC, Mode::IndirectX,   6);
+	set(0x71, Op::ADC, Mode::IndirectY,   5, PagePenalty);
+	set(0x29, Op::AND, Mode::Immediate,   2);
+	set(0x25, Op::AND, Mode::ZeroPage,    3);
+	set(0x35, Op::AND, Mode::ZeroPageX,   4);
+	set(0x2D, Op::AND, Mode::Absolute,    4);
+	set(0x3D, Op::AND, Mode::AbsoluteX,   4, PagePenalty);
+	set(0x39, Op::AND, Mode::AbsoluteY,   4, PagePenalty);
+	set(0x21, Op::AND, Mode::IndirectX,   6);
+	set(0x31, Op::AND, Mode::IndirectY,   5, PagePenalty);
+	set(0x0A, Op::ASL, Mode::Accumulator, 2);
+	set(0x06, Op::ASL, Mode::ZeroPage,    5);
+	set(0x16, Op::ASL, Mode::ZeroPageX,   6);
+	set(0x0E, Op::ASL, Mode::Absolute,    6);
+	set(0x1E, Op::ASL, Mode::AbsoluteX,   7);
+	set(0x90, Op::BCC, Mode::Relative,    2);
+	set(0xB0, Op::BCS, Mode::Relative,    2);
+	set(0xF0, Op::BEQ, Mode::Relative,    2);
+	set(0x24, Op::BIT, Mode::ZeroPage,    3);
+	set(0x2C, Op::BIT, Mode::Absolute,    4);
+	set(0x30, Op::BMI, Mode::Relative,    2);
+	set(0xD0, Op::BNE, Mode::Relative,    2);
+	set(0x10, Op::BPL, Mode::Relative,    2);
+	set(0x00, Op::BRK, Mode::Implied,     7);
+	set(0x50, Op::BVC, Mode::Relative,    2);
+	set(0x70, Op::BVS, Mode::Relative,    2);
+	set(0x18, Op::CLC, Mode::Implied,     2);
+	set(0xD8, Op::CLD, Mode::Implied,     2);
+	set(0x58, Op::CLI, Mode::Implied,     2);
+	set(0xB8, Op::CLV, Mode::Implied,     2);
+	set(0xC9, Op::CMP, Mode::Immediate,   2);
+	set(0xC5, Op::CMP, Mode::ZeroPage,    3);
+	set(0xD5, Op::CMP, Mode::ZeroPageX,   4);
+	set(0xCD, Op::CMP, Mode::Absolute,    4);
+	set(0xDD, Op::CMP, Mode::AbsoluteX,   4, PagePenalty);
+	set(0xD9, Op::CMP, Mode::AbsoluteY,   4, PagePenalty);
+	set(0xC1, Op::CMP, Mode::IndirectX,   6);
+	set(0xD1, Op::CMP, Mode::IndirectY,   5, PagePenalty);
+	set(0xE0, Op::CPX, Mode::Immediate,   2);
+	set(0xE4, Op::CPX, Mode::ZeroPage,    3);
+	set(0xEC, Op::CPX, Mode::Absolute,    4);
+	set(0xC0, Op::CPY, Mode::Immediate,   2);
+	set(0xC4, Op::CPY, Mode::ZeroPage,    3);
+	set(0xCC, Op::CPY, Mode::Absolute,    4);
+	set(0xC6, Op::DEC, Mode::ZeroPage,    5);
+	set(0xD6, Op::DEC, Mode::ZeroPageX,   6);
+	set(0xCE, Op::DEC, Mode::Absolute,    6);
+	set(0xDE, Op::DEC, Mode::AbsoluteX,   7);
+	set(0xCA, Op::DEX, Mode::Implied,     2);
+	set(0x88, Op::DEY, Mode::Implied,     2);
+	set(0x49, Op::EOR, Mode::Immediate,   2);
+	set(0x45, Op::EOR, Mode::ZeroPage,    3);
+	set(0x55, Op::EOR, Mode::ZeroPageX,   4);
+	set(0x4D, Op::EOR, Mode::Absolute,    4);
+	set(0x5D, Op::EOR, Mode::AbsoluteX,   4, PagePenalty);
+	set(0x59, Op::EOR, Mode::AbsoluteY,   4, PagePenalty);
+	set(0x41, Op::EOR, Mode::IndirectX,   6);
+	set(0x51, Op::EOR, Mode::IndirectY,   5, PagePenalty);
+	set(0xE6, Op::INC, Mode::ZeroPage,    5);
+	set(0xF6, Op::INC, Mode::ZeroPageX,   6);
+	set(0xEE, Op::INC, Mode::Absolute,    6);
+	set(0xFE, Op::INC, Mode::AbsoluteX,   7);
+	set(0xE8, Op::INX, Mode::Implied,     2);
+	set(0xC8, Op::INY, Mode::Implied,     2);
+	set(0x4C, Op::JMP, Mode::Absolute,    3);
+	set(0x6C, Op::JMP, Mode::Indirect,    5);
+	set(0x20, Op::JSR, Mode::Absolute,    6);
+	set(0xA9, Op::LDA, Mode::Immediate,   2);
+	set(0xA5, Op::LDA, Mode::ZeroPage,    3);
+	set(0xB5, Op::LDA, Mode::ZeroPageX,   4);
+	set(0xAD, Op::LDA, Mode::Absolute,    4);
+	set(0xBD, Op::LDA, Mode::AbsoluteX,   4, PagePenalty);
+	set(0xB9, Op::LDA, Mode::AbsoluteY,   4, PagePenalty);
+	set(0xA1, Op::LDA, Mode::IndirectX,   6);
+	set(0xB1, Op::LDA, Mode::IndirectY,   5, PagePenalty);
+	set(0xA2, Op::LDX, Mode::Immediate,   2);
+	set(0xA6, Op::LDX, Mode::ZeroPage,    3);
+	set(0xB6, Op::LDX, Mode::ZeroPageY,   4);
+	set(0xAE, Op::LDX, Mode::Absolute,    4);
+	set(0xBE, Op::LDX, Mode::AbsoluteY,   4, PagePenalty);
+	set(0xA0, Op::LDY, Mode::Immediate,   2);
+	set(0xA4, Op::LDY, Mode::ZeroPage,    3);
+	set(0xB4, Op::LDY, Mode::ZeroPageX,   4);
+	set(0xAC, Op::LDY, Mode::Absolute,    4);
+	set(0xBC, Op::LDY, Mode::AbsoluteX,   4, PagePenalty);
+	set(0x4A, Op::LSR, Mode::Accumulator, 2);
+	set(0x46, Op::LSR, Mode::ZeroPage,    5);
+	set(0x56, Op::LSR, Mode::ZeroPageX,   6);
+	set(0x4E, Op::LSR, Mode::Absolute,    6);
+	set(0x5E, Op::LSR, Mode::AbsoluteX,   7);
+	set(0xEA, Op::NOP, Mode::Implied,     2);
+	set(0x09, Op::ORA, Mode::Immediate,   2);
+	set(0x05, Op::ORA, Mode::ZeroPage,    3);
+	set(0x15, Op::ORA, Mode::ZeroPageX,   4);
+	set(0x0D, Op::ORA, Mode::Absolute,    4);
+	set(0x1D, Op::ORA, Mode::AbsoluteX,   4, PagePenalty);
+	set(0x19, Op::ORA, Mode::AbsoluteY,   4, PagePenalty);
+	set(0x01, Op::ORA, Mode::IndirectX,   6);
+	set(0x11, Op::ORA, Mode::IndirectY,   5, PagePenalty);
+	set(0x48, Op::PHA, Mode::Implied,     3);
+	set(0x08, Op::PHP, Mode::Implied,     3);
+	set(0x68, Op::PLA, Mode::Implied,     4);
+	set(0x28, Op::PLP, Mode::Implied,     4);
+	set(0x2A, Op::ROL, Mode::Accumulator, 2);
+	set(0x26, Op::ROL, Mode::ZeroPage,    5);
+	set(0x36, Op::ROL, Mode::ZeroPageX,   6);
+	set(0x2E, Op::ROL, Mode::Absolute,    6);
+	set(0x3E, Op::ROL, Mode::AbsoluteX,   7);
+	set(0x6A, Op::ROR, Mode::Accumulator, 2);
+	set(0x66, Op::ROR, Mode::ZeroPage,    5);
+	set(0x76, Op::ROR, Mode::ZeroPageX,   6);
+	set(0x6E, Op::ROR, Mode::Absolute,    6);
+	set(0x7E, Op::ROR, Mode::AbsoluteX,   7);
+	set(0x40, Op::RTI, Mode::Implied,     6);
+	set(0x60, Op::RTS, Mode::Implied,     6);
+	set(0xE9, Op::SBC, Mode::Immediate,   2);
+	set(0xE5, Op::SBC, Mode::ZeroPage,    3);
+	set(0xF5, Op::SBC, Mode::ZeroPageX,   4);
+	set(0xED, Op::SBC, Mode::Absolute,    4);
+	set(0xFD, Op::SBC, Mode::AbsoluteX,   4, PagePenalty);
+	set(0xF9, Op::SBC, Mode::AbsoluteY,   4, PagePenalty);
+	set(0xE1, Op::SBC, Mode::IndirectX,   6);
+	set(0xF1, Op::SBC, Mode::IndirectY,   5, PagePenalty);
+	set(0x38, Op::SEC, Mode::Implied,     2);
+	set(0xF8, Op::SED, Mode::Implied,     2);
+	set(0x78, Op::SEI, Mode::Implied,     2);
+	set(0x85, Op::STA, Mode::ZeroPage,    3);
+	set(0x95, Op::STA, Mode::ZeroPageX,   4);
+	set(0x8D, Op::STA, Mode::Absolute,    4);
+	set(0x9D, Op::STA, Mode::AbsoluteX,   5);
+	set(0x99, Op::STA, Mode::AbsoluteY,   5);
+	set(0x81, Op::STA, Mode::IndirectX,   6);
+	set(0x91, Op::STA, Mode::IndirectY,   6);
+	set(0x86, Op::STX, Mode::ZeroPage,    3);
+	set(0x96, Op::STX, Mode::ZeroPageY,   4);
+	set(0x8E, Op::STX, Mode::Absolute,    4);
+	set(0x84, Op::STY, Mode::ZeroPage,    3);
+	set(0x94, Op::STY, Mode::ZeroPageX,   4);
+	set(0x8C, Op::STY, Mode::Absolute,    4);
+	set(0xAA, Op::TAX, Mode::Implied,     2);
+	set(0xA8, Op::TAY, Mode::Implied,     2);
+	set(0xBA, Op::TSX, Mode::Implied,     2);
+	set(0x8A, Op::TXA, Mode::Implied,     2);
+	set(0x9A, Op::TXS, Mode::Implied,     2);
+	set(0x98, Op::TYA, Mode::Implied,     2);
+
+	set(0x1A, Op::NOP, Mode::Implied,     2, Unofficial);
+	set(0x3A, Op::NOP, Mode::Implied,     2, Unofficial);
+	set(0x5A, Op::NOP, Mode::Implied,     2, Unofficial);
+	set(0x7A, Op::NOP, Mode::Implied,     2, Unofficial);
+	set(0xDA, Op::NOP, Mode::Implied,     2, Unofficial);
+	set(0xFA, Op::NOP, Mode::Implied,     2, Unofficial);
+	set(0x80, Op::NOP, Mode::Immediate,   2, Unofficial);
+	set(0x04, Op::NOP, Mode::ZeroPage,    3, Unofficial);
+	set(0x44, Op::NOP, Mode::ZeroPage,    3, Unofficial);
+	set(0x64, Op::NOP, Mode::ZeroPage,    3, Unofficial);
+	set(0x14, Op::NOP, Mode::ZeroPageX,   4, Unofficial);
+	set(0x34, Op::NOP, Mode::ZeroPageX,   4, Unofficial);
+	set(0x54, Op::NOP, Mode::ZeroPageX,   4, Unofficial);
+	set(0x74, Op::NOP, Mode::ZeroPageX,   4, Unofficial);
+	set(0xD4, Op::NOP, Mode::ZeroPageX,   4, Unofficial);
+	set(0xF4, Op::NOP, Mode::ZeroPageX,   4, Unofficial);
+	set(0x0C, Op::NOP, Mode::Absolute,    4, Unofficial);
+	set(0x1C, Op::NOP, Mode::AbsoluteX,   4, PagePenalty | Unofficial);
+	set(0x3C, Op::NOP, Mode::AbsoluteX,   4, PagePenalty | Unofficial);
+	set(0x5C, Op::NOP, Mode::AbsoluteX,   4, PagePenalty | Unofficial);
+	set(0x7C, Op::NOP, Mode::AbsoluteX,   4, PagePenalty | Unofficial);
+	set(0xDC, Op::NOP, Mode::AbsoluteX,   4, PagePenalty | Unofficial);
+	set(0xFC, Op::NOP, Mode::AbsoluteX,   4, PagePenalty | Unofficial);
+	set(0xEB, Op::SBC, Mode::Immediate,   2, Unofficial);
+	set(0xA7, Op::LAX, Mode::ZeroPage,    3, Unofficial);
+	set(0xB7, Op::LAX, Mode::ZeroPageY,   4, Unofficial);
+	set(0xAF, Op::LAX, Mode::Absolute,    4, Unofficial);
+	set(0xBF, Op::LAX, Mode::AbsoluteY,   4, PagePenalty | Unofficial);
+	set(0xA3, Op::LAX, Mode::IndirectX,   6, Unofficial);
+	set(0xB3, Op::LAX, Mode::IndirectY,   5, PagePenalty | Unofficial);
+	set(0x87, Op::SAX, Mode::ZeroPage,    3, Unofficial);
+	set(0x97, Op::SAX, Mode::ZeroPageY,   4, Unofficial);
+	set(0x8F, Op::SAX, Mode::Absolute,    4, Unofficial);
+	set(0x83, Op::SAX, Mode::IndirectX,   6, Unofficial);
+
+	return result;
+}
+
+inline constexpr std::array<CPU6502OpcodeInfo, 256> CPU6502Opcodes::table = makeTable();
+
+constexpr const CPU6502OpcodeInfo& CPU6502Opcodes::get(uint8_t opcode)
+{
+	return table[opcode];
+}
@@ -43,6 +43,12 @@ void GameStage::onVariableUpdate(Time t)
 	if (getInputAPI().getKeyboard()->isButtonPressed(KeyCode::F2)) {
 		perfView->setActive(!perfView->isActive());
 	}
+	if (getInputAPI().getKeyboard()->isButtonPressed(KeyCode::F3)) {
+		nes->setPairHistogramEnabled(!nes->isPairHistogramEnabled());
+	}
+	if (getInputAPI().getKeyboard()->isButtonPressed(KeyCode::F4)) {
+		nes->setBusProfilingEnabled(!nes->isBusProfilingEnabled());
+	}
 	perfView->update();
 }
 
@@ -5,6 +5,23 @@ void NESAPU::tick()
 	++cycle;
 }
 
+void NESAPU::runUntil(uint64_t targetCycle)
+{
+	// Nothing is generated yet, so there's no need to go a cycle at a time. The DMC only needs to know when its
+	// buffer got emptied, which happens at the start of each of its output cycles (an APU cycle is 2 CPU cycles).
+	while (dmcNextOutputCycle <= targetCycle * 2) {
+		if (dmcBufferFull) {
+			dmcBufferFull = false;
+			dmcBufferEmptiedCycle = dmcNextOutputCycle;
+		}
+		dmcNextOutputCycle += getDMCOutputCycleLength();
+	}
+
+	if (cycle < targetCycle) {
+		cycle = targetCycle;
+	}
+}
+
 void NESAPU::writeRegister(uint16_t address, uint8_t value)
 {
 	switch (address) {
@@ -74,7 +91,11 @@ void NESAPU::writeRegister(uint16_t address, uint8_t value)
 	    break;
 	case 0x4010:
 		// DMC_FREQ
-	    // TODO
+		// A new rate only takes over once the current output cycle is done
+		dmcControl = value;
+		if (!(value & 0x80)) {
+			dmcIRQ = false;
+		}
 	    break;
 	case 0x4011:
 		// DMC_RAW
@@ -82,15 +103,24 @@ void NESAPU::writeRegister(uint16_t address, uint8_t value)
 	    break;
 	case 0x4012:
 		// DMC_START
-	    // TODO
+		dmcStartAddress = uint16_t(0xC000 | (value << 6));
 	    break;
 	case 0x4013:
 		// DMC_LEN
-	    // TODO
+		dmcLength = uint16_t((value << 4) | 1);
 	    break;
 	case 0x4015:
 		// Control/status
-	    // TODO
+		// TODO: other channels
+		dmcIRQ = false;
+		if (!(value & 0x10)) {
+			dmcBytesLeft = 0;
+		} else if (dmcBytesLeft == 0) {
+			restartDMC();
+			if (!dmcBufferFull) {
+				dmcBufferEmptiedCycle = cycle * 2;
+			}
+		}
 	    break;
 	case 0x4017:
 		// Frame counter
@@ -102,7 +132,8 @@ uint8_t NESAPU::readRegister(uint16_t address)
 {
 	if (address == 0x4015) {
 		// SND_CHN
-		// TODO
+		// TODO: other channels
+		return uint8_t((dmcBytesLeft > 0 ? 0x10 : 0) | (dmcIRQ ? 0x80 : 0));
 	}
 
 	return 0;
@@ -112,3 +143,46 @@ uint64_t NESAPU::getCycle() const
 {
 	return cycle;
 }
+
+uint64_t NESAPU::getNextDMCFetchCycle() const
+{
+	if (dmcBytesLeft == 0) {
+		return noDMCFetch;
+	}
+	return dmcBufferFull ? dmcNextOutputCycle : dmcBufferEmptiedCycle;
+}
+
+uint16_t NESAPU::getDMCFetchAddress() const
+{
+	return dmcAddress;
+}
+
+void NESAPU::onDMCFetch(uint8_t value)
+{
+	dmcBuffer = value;
+	dmcBufferFull = true;
+	dmcAddress = dmcAddress == 0xFFFF ? 0x8000 : uint16_t(dmcAddress + 1);
+	if (--dmcBytesLeft == 0) {
+		if (dmcControl & 0x40) {
+			restartDMC();
+		} else if (dmcControl & 0x80) {
+			dmcIRQ = true;
+		}
+	}
+}
+
+bool NESAPU::isDMCIRQAsserted() const
+{
+	return dmcIRQ;
+}
+
+uint32_t NESAPU::getDMCOutputCycleLength() const
+{
+	return 8 * dmcRates[dmcControl & 0x0F];
+}
+
+void NESAPU::restartDMC()
+{
+	dmcAddress = dmcStartAddress;
+	dmcBytesLeft = dmcLength;
+}
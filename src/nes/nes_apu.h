@@ -3,13 +3,41 @@
 
 class NESAPU {
 public:
+	constexpr static uint64_t noDMCFetch = UINT64_MAX;
+
 	void tick();
+	void runUntil(uint64_t targetCycle);
 	
 	void writeRegister(uint16_t address, uint8_t value);
 	uint8_t readRegister(uint16_t address);
 
 	uint64_t getCycle() const;
 
+	// The DMC's memory reader, which needs a sample byte whenever its buffer is empty and the sample has bytes left.
+	// The machine schedules a DMA for each one and hands the byte over with onDMCFetch. Times are in CPU cycles.
+	// Nothing gets played yet: the output unit only empties the buffer at its normal rate.
+	uint64_t getNextDMCFetchCycle() const;
+	uint16_t getDMCFetchAddress() const;
+	void onDMCFetch(uint8_t value);
+	bool isDMCIRQAsserted() const;
+
 private:
+	// CPU cycles per output bit, by the low 4 bits of $4010 (NTSC)
+	constexpr static uint16_t dmcRates[16] = { 428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54 };
+
 	uint64_t cycle = 0;
+
+	uint8_t dmcControl = 0;
+	uint16_t dmcStartAddress = 0xC000;
+	uint16_t dmcLength = 1;
+	uint16_t dmcAddress = 0xC000;
+	uint16_t dmcBytesLeft = 0;
+	uint8_t dmcBuffer = 0;
+	bool dmcBufferFull = false;
+	bool dmcIRQ = false;
+	uint64_t dmcBufferEmptiedCycle = 0; // When the buffer last went empty, i.e. when a fetch was first due
+	uint64_t dmcNextOutputCycle = 8 * dmcRates[0]; // When the output unit next starts a byte, taking the buffer
+
+	uint32_t getDMCOutputCycleLength() const;
+	void restartDMC();
 };
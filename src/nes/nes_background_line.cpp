@@ -0,0 +1,76 @@
+#include "nes_background_line.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define EMUND_BACKGROUND_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define EMUND_BACKGROUND_SSE2
+#endif
+
+namespace {
+#if defined(EMUND_BACKGROUND_AVX2) || defined(EMUND_BACKGROUND_SSE2)
+	// 8 copies of the palette, moved to bits 2-3
+	uint64_t spreadPalette(uint8_t palette)
+	{
+		return uint64_t(palette << 2) * 0x0101010101010101ull;
+	}
+
+	uint64_t loadRow(const NESTileCache::Row* row)
+	{
+		uint64_t result;
+		memcpy(&result, row->data(), sizeof(result));
+		return result;
+	}
+#endif
+
+	void finish(const uint8_t* line, uint8_t fineX, size_t start, NESBackgroundLine::Pixels& pixels)
+	{
+		// The line has 272 pixels, of which fine x picks the 256 shown
+		std::fill_n(pixels.begin(), start, uint8_t(0));
+		memcpy(pixels.data() + start, line + fineX + start, 256 - start);
+	}
+}
+
+void NESBackgroundLine::compose(const Tiles& tiles, const Palettes& palettes, uint8_t fineX, size_t start, Pixels& pixels)
+{
+#if defined(EMUND_BACKGROUND_AVX2)
+	alignas(32) uint8_t line[numTiles * 8];
+	size_t i = 0;
+	for (; i + 4 <= numTiles; i += 4) {
+		const __m256i rows = _mm256_set_epi64x(loadRow(tiles[i + 3]), loadRow(tiles[i + 2]), loadRow(tiles[i + 1]), loadRow(tiles[i]));
+		const __m256i spread = _mm256_set_epi64x(spreadPalette(palettes[i + 3]), spreadPalette(palettes[i + 2]), spreadPalette(palettes[i + 1]), spreadPalette(palettes[i]));
+		_mm256_store_si256(reinterpret_cast<__m256i*>(line + i * 8), _mm256_or_si256(rows, spread));
+	}
+	for (; i < numTiles; i += 2) {
+		const __m128i rows = _mm_set_epi64x(loadRow(tiles[i + 1]), loadRow(tiles[i]));
+		const __m128i spread = _mm_set_epi64x(spreadPalette(palettes[i + 1]), spreadPalette(palettes[i]));
+		_mm_store_si128(reinterpret_cast<__m128i*>(line + i * 8), _mm_or_si128(rows, spread));
+	}
+	finish(line, fineX, start, pixels);
+#elif defined(EMUND_BACKGROUND_SSE2)
+	alignas(16) uint8_t line[numTiles * 8];
+	for (size_t i = 0; i < numTiles; i += 2) {
+		const __m128i rows = _mm_set_epi64x(loadRow(tiles[i + 1]), loadRow(tiles[i]));
+		const __m128i spread = _mm_set_epi64x(spreadPalette(palettes[i + 1]), spreadPalette(palettes[i]));
+		_mm_store_si128(reinterpret_cast<__m128i*>(line + i * 8), _mm_or_si128(rows, spread));
+	}
+	finish(line, fineX, start, pixels);
+#else
+	composeScalar(tiles, palettes, fineX, start, pixels);
+#endif
+}
+
+void NESBackgroundLine::composeScalar(const Tiles& tiles, const Palettes& palettes, uint8_t fineX, size_t start, Pixels& pixels)
+{
+	uint8_t line[numTiles * 8];
+	for (size_t i = 0; i < numTiles; ++i) {
+		for (size_t j = 0; j < 8; ++j) {
+			line[i * 8 + j] = uint8_t((*tiles[i])[j] | (palettes[i] << 2));
+		}
+	}
+	finish(line, fineX, start, pixels);
+}
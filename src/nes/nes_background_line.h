@@ -0,0 +1,20 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "nes_tile_cache.h"
+
+// Puts together a scanline of background pixels, value in bits 0-1 and palette in bits 2-3, from the decoded rows of
+// the 34 tiles fetched for it and their attribute bits. Works on 32 pixels at a time with AVX2, 16 with SSE2, and
+// one at a time on anything else.
+class NESBackgroundLine {
+public:
+	constexpr static size_t numTiles = 34;
+	using Tiles = std::array<const NESTileCache::Row*, numTiles>;
+	using Palettes = std::array<uint8_t, numTiles>;
+	using Pixels = std::array<uint8_t, 256>;
+
+	// Rows may already have palette bits in them, for tiles whose palette changes halfway through.
+	// Pixels left of start are left at 0.
+	static void compose(const Tiles& tiles, const Palettes& palettes, uint8_t fineX, size_t start, Pixels& pixels);
+	static void composeScalar(const Tiles& tiles, const Palettes& palettes, uint8_t fineX, size_t start, Pixels& pixels);
+};
@@ -0,0 +1,192 @@
+#include "nes_cheats.h"
+#include "src/cpu/address_space.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace {
+	int parseHexDigit(char c)
+	{
+		if (c >= '0' && c <= '9') {
+			return c - '0';
+		} else if (c >= 'A' && c <= 'F') {
+			return c - 'A' + 10;
+		} else if (c >= 'a' && c <= 'f') {
+			return c - 'a' + 10;
+		}
+		return -1;
+	}
+
+	std::optional<uint16_t> parseHex(std::string_view str, size_t maxDigits)
+	{
+		if (str.empty() || str.size() > maxDigits) {
+			return {};
+		}
+		uint16_t result = 0;
+		for (char c: str) {
+			const int digit = parseHexDigit(c);
+			if (digit < 0) {
+				return {};
+			}
+			result = uint16_t((result << 4) | digit);
+		}
+		return result;
+	}
+}
+
+std::optional<NESCheat> NESCheats::parse(std::string_view code)
+{
+	if (auto cheat = parseGameGenie(code)) {
+		return cheat;
+	}
+	return parseRaw(code);
+}
+
+std::optional<NESCheat> NESCheats::parseGameGenie(std::string_view code)
+{
+	if (code.size() != 6 && code.size() != 8) {
+		return {};
+	}
+
+	constexpr std::string_view letters = "APZLGITYEOXUKSVN";
+	std::array<uint8_t, 8> n = {};
+	for (size_t i = 0; i < code.size(); ++i) {
+		const auto index = letters.find(char(toupper(code[i])));
+		if (index == std::string_view::npos) {
+			return {};
+		}
+		n[i] = uint8_t(index);
+	}
+
+	// Every letter is 4 bits, scattered all over the address, value and compare
+	NESCheat cheat;
+	cheat.address = uint16_t(0x8000
+		| ((n[3] & 7) << 12)
+		| ((n[5] & 7) << 8) | ((n[4] & 8) << 8)
+		| ((n[2] & 7) << 4) | ((n[1] & 8) << 4)
+		| (n[4] & 7) | (n[3] & 8));
+
+	if (code.size() == 6) {
+		cheat.value = uint8_t(((n[1] & 7) << 4) | ((n[0] & 8) << 4) | (n[0] & 7) | (n[5] & 8));
+	} else {
+		cheat.value = uint8_t(((n[1] & 7) << 4) | ((n[0] & 8) << 4) | (n[0] & 7) | (n[7] & 8));
+		cheat.compare = uint8_t(((n[7] & 7) << 4) | ((n[6] & 8) << 4) | (n[6] & 7) | (n[5] & 8));
+	}
+	return cheat;
+}
+
+std::optional<NESCheat> NESCheats::parseRaw(std::string_view code)
+{
+	const auto colon = code.find(':');
+	if (colon == std::string_view::npos) {
+		return {};
+	}
+
+	const auto question = code.substr(0, colon).find('?');
+	const auto address = parseHex(code.substr(0, std::min(colon, question)), 4);
+	const auto value = parseHex(code.substr(colon + 1), 2);
+	if (!address || !value) {
+		return {};
+	}
+
+	NESCheat cheat;
+	cheat.address = *address;
+	cheat.value = uint8_t(*value);
+	if (question != std::string_view::npos) {
+		const auto compare = parseHex(code.substr(question + 1, colon - question - 1), 2);
+		if (!compare) {
+			return {};
+		}
+		cheat.compare = uint8_t(*compare);
+	}
+	return cheat;
+}
+
+NESCheats::NESCheats(AddressSpace8BitBy16Bit& addressSpace)
+	: addressSpace(addressSpace)
+{
+	addressSpace.setPagePatcher(this, &NESCheats::patchPage);
+}
+
+NESCheats::~NESCheats()
+{
+	clear();
+	addressSpace.setPagePatcher(nullptr, nullptr);
+}
+
+void NESCheats::add(const NESCheat& cheat)
+{
+	if (cheat.address >= 0x8000) {
+		romPatches.push_back(cheat);
+		refreshPage(uint8_t(cheat.address >> 8));
+	} else {
+		freezes.push_back(cheat);
+	}
+}
+
+void NESCheats::clear()
+{
+	std::vector<NESCheat> patches;
+	std::swap(patches, romPatches);
+	for (const auto& patch: patches) {
+		refreshPage(uint8_t(patch.address >> 8));
+	}
+	freezes.clear();
+}
+
+bool NESCheats::isEmpty() const
+{
+	return romPatches.empty() && freezes.empty();
+}
+
+void NESCheats::applyFreezes()
+{
+	for (const auto& freeze: freezes) {
+		if (!freeze.compare || addressSpace.readDirect(freeze.address) == *freeze.compare) {
+			addressSpace.write(freeze.address, freeze.value);
+		}
+	}
+}
+
+void NESCheats::refreshPage(uint8_t page)
+{
+	// Puts the original back in before throwing away any copies of it, as one of them might be mapped
+	addressSpace.setPagePatched(page, false);
+	for (auto iter = shadowPages.begin(); iter != shadowPages.end();) {
+		if (iter->first.first == page) {
+			iter = shadowPages.erase(iter);
+		} else {
+			++iter;
+		}
+	}
+
+	const bool patched = std::any_of(romPatches.begin(), romPatches.end(), [&] (const NESCheat& patch)
+	{
+		return (patch.address >> 8) == page;
+	});
+	addressSpace.setPagePatched(page, patched);
+}
+
+uint8_t* NESCheats::patchPage(void* self, uint8_t page, uint8_t* source)
+{
+	// Called whenever a page with patches gets mapped, so each bank only needs to be copied the first time
+	auto& cheats = *static_cast<NESCheats*>(self);
+	if (!source) {
+		return source;
+	}
+
+	auto [iter, inserted] = cheats.shadowPages.try_emplace(std::make_pair(page, static_cast<const uint8_t*>(source)));
+	auto& shadow = iter->second;
+	if (inserted) {
+		memcpy(shadow.data.data(), source, shadow.data.size());
+		for (const auto& patch: cheats.romPatches) {
+			const uint8_t offset = patch.address & 0xFF;
+			if ((patch.address >> 8) == page && (!patch.compare || source[offset] == *patch.compare)) {
+				shadow.data[offset] = patch.value;
+				shadow.patched = true;
+			}
+		}
+	}
+	return shadow.patched ? shadow.data.data() : source;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class AddressSpace8BitBy16Bit;
+
+struct NESCheat {
+	uint16_t address = 0;
+	uint8_t value = 0;
+	std::optional<uint8_t> compare; // Only applies while the original byte has this value
+};
+
+// Game Genie codes and raw patches. Patches to ROM go into shadow copies of the pages they touch, which get mapped
+// in place of the originals (bank switches included), so reads never check for cheats. Patches anywhere else freeze
+// that address, and get applied once per frame.
+class NESCheats {
+public:
+	// Game Genie codes (6 or 8 letters), or raw patches as AAAA:VV or AAAA?CC:VV, in hex
+	static std::optional<NESCheat> parse(std::string_view code);
+	static std::optional<NESCheat> parseGameGenie(std::string_view code);
+	static std::optional<NESCheat> parseRaw(std::string_view code);
+
+	explicit NESCheats(AddressSpace8BitBy16Bit& addressSpace);
+	~NESCheats();
+
+	void add(const NESCheat& cheat);
+	void clear();
+	bool isEmpty() const;
+
+	void applyFreezes();
+
+private:
+	struct ShadowPage {
+		bool patched = false;
+		std::array<uint8_t, 256> data;
+	};
+
+	AddressSpace8BitBy16Bit& addressSpace;
+	std::vector<NESCheat> romPatches;
+	std::vector<NESCheat> freezes;
+
+	// By CPU page and the memory mapped there, since the same bank can show up at different addresses
+	std::map<std::pair<uint8_t, const uint8_t*>, ShadowPage> shadowPages;
+
+	static uint8_t* patchPage(void* self, uint8_t page, uint8_t* source);
+	void refreshPage(uint8_t page);
+};
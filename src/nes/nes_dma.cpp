@@ -0,0 +1,36 @@
+#include "nes_dma.h"
+#include "src/cpu/address_space.h"
+#include "src/cpu/cpu_6502.h"
+
+#include <cstring>
+
+NESDMA::NESDMA(CPU6502& cpu, AddressSpace8BitBy16Bit& addressSpace)
+	: cpu(cpu)
+	, addressSpace(addressSpace)
+{
+}
+
+void NESDMA::runOAMDMA(uint8_t page, gsl::span<uint8_t> oam)
+{
+	Expects(oam.size() >= 256);
+
+	// Plain memory (RAM, PRG RAM or ROM) is copied in one go. Anything with registers, breakpoints or a profiler
+	// on it has to see each read.
+	if (addressSpace.isPlainReadMemory(page) && addressSpace.getPageMask(page) == 0xFF && !addressSpace.isInstrumented()) {
+		memcpy(oam.data(), addressSpace.getPage(page), 256);
+	} else {
+		const uint16_t base = uint16_t(page) << 8;
+		for (uint16_t i = 0; i < 256; ++i) {
+			oam[i] = addressSpace.read(base | i);
+		}
+	}
+
+	cpu.stall(oamDMACycles + (cpu.getCycle() & 1));
+}
+
+uint8_t NESDMA::runDMCFetch(uint16_t address)
+{
+	const uint8_t value = addressSpace.read(address);
+	cpu.stall(dmcFetchCycles);
+	return value;
+}
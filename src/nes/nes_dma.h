@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <gsl/span>
+
+class CPU6502;
+class AddressSpace8BitBy16Bit;
+
+// OAM DMA ($4014) and DMC sample fetches. Both take the CPU bus over, halting the CPU for the cycles they use.
+// The CPU runs ahead of the PPU and APU, so stealing its cycles pushes back everything it does next, and the
+// machine's usual catching up keeps the PPU and APU in step with that. DMC fetches are asked for by the APU, so the
+// machine runs them from a scheduled event at the cycle the APU wants them, rather than whenever the APU catches up.
+class NESDMA {
+public:
+	NESDMA(CPU6502& cpu, AddressSpace8BitBy16Bit& addressSpace);
+
+	// Copies a page into OAM, halting the CPU for 513 cycles, or 514 when it starts on an odd one
+	void runOAMDMA(uint8_t page, gsl::span<uint8_t> oam);
+
+	// Reads a sample byte for the DMC, halting the CPU for 4 cycles
+	uint8_t runDMCFetch(uint16_t address);
+
+private:
+	constexpr static uint32_t oamDMACycles = 513;
+	constexpr static uint32_t dmcFetchCycles = 4;
+
+	CPU6502& cpu;
+	AddressSpace8BitBy16Bit& addressSpace;
+};
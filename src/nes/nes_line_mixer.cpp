@@ -0,0 +1,67 @@
+#include "nes_line_mixer.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define EMUND_LINE_MIXER_SSE2
+#endif
+
+int NESLineMixer::mix(const Pixels& background, const Pixels& sprites, Pixels& indices)
+{
+#if defined(EMUND_LINE_MIXER_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i valueMask = _mm_set1_epi8(0x03);
+	const __m128i indexMask = _mm_set1_epi8(0x0F);
+	const __m128i spritePalettes = _mm_set1_epi8(0x10);
+	const __m128i behindMask = _mm_set1_epi8(char(spriteBehindBackground));
+	const __m128i zeroMask = _mm_set1_epi8(char(spriteZero));
+
+	int hit = -1;
+	for (size_t x = 0; x < 256; x += 16) {
+		const __m128i bg = _mm_loadu_si128(reinterpret_cast<const __m128i*>(background.data() + x));
+		const __m128i sprite = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sprites.data() + x));
+
+		const __m128i bgTransparent = _mm_cmpeq_epi8(_mm_and_si128(bg, valueMask), zero);
+		const __m128i spriteTransparent = _mm_cmpeq_epi8(_mm_and_si128(sprite, valueMask), zero);
+		const __m128i spriteInFront = _mm_cmpeq_epi8(_mm_and_si128(sprite, behindMask), zero);
+		const __m128i useSprite = _mm_andnot_si128(spriteTransparent, _mm_or_si128(spriteInFront, bgTransparent));
+
+		const __m128i bgIndex = _mm_andnot_si128(bgTransparent, _mm_and_si128(bg, indexMask));
+		const __m128i spriteIndex = _mm_or_si128(_mm_and_si128(sprite, indexMask), spritePalettes);
+		const __m128i index = _mm_or_si128(_mm_and_si128(useSprite, spriteIndex), _mm_andnot_si128(useSprite, bgIndex));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(indices.data() + x), index);
+
+		if (hit < 0) {
+			const __m128i isSpriteZero = _mm_cmpeq_epi8(_mm_and_si128(sprite, zeroMask), zeroMask);
+			const int hits = _mm_movemask_epi8(_mm_andnot_si128(_mm_or_si128(bgTransparent, spriteTransparent), isSpriteZero));
+			for (int i = 0; hits != 0 && i < 16; ++i) {
+				if (hits & (1 << i)) {
+					hit = int(x) + i;
+					break;
+				}
+			}
+		}
+	}
+	return hit;
+#else
+	return mixScalar(background, sprites, indices);
+#endif
+}
+
+int NESLineMixer::mixScalar(const Pixels& background, const Pixels& sprites, Pixels& indices)
+{
+	int hit = -1;
+	for (size_t x = 0; x < 256; ++x) {
+		const uint8_t bg = background[x];
+		const uint8_t sprite = sprites[x];
+		const bool bgOpaque = (bg & 0x3) != 0;
+		const bool spriteOpaque = (sprite & 0x3) != 0;
+		const bool useSprite = spriteOpaque && (!bgOpaque || !(sprite & spriteBehindBackground));
+
+		// Sprites use the upper 4 palettes
+		indices[x] = useSprite ? uint8_t(0x10 | (sprite & 0xF)) : uint8_t(bgOpaque ? bg & 0xF : 0);
+		if (hit < 0 && bgOpaque && spriteOpaque && (sprite & spriteZero)) {
+			hit = int(x);
+		}
+	}
+	return hit;
+}
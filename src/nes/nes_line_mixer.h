@@ -0,0 +1,20 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Picks between a line of background pixels and a line of sprite pixels, giving the palette RAM index of each pixel.
+// Works on 16 pixels at a time with SSE2, and one at a time on anything else.
+class NESLineMixer {
+public:
+	using Pixels = std::array<uint8_t, 256>;
+
+	// Background pixels: value in bits 0-1, palette in bits 2-3
+	// Sprite pixels: the same, plus these
+	constexpr static uint8_t spriteBehindBackground = 0x10;
+	constexpr static uint8_t spriteZero = 0x20; // From secondary OAM slot 0, which is what sprite 0 hits look for
+
+	// Returns the first pixel where sprite 0 hits, or -1
+	static int mix(const Pixels& background, const Pixels& sprites, Pixels& indices);
+	static int mixScalar(const Pixels& background, const Pixels& sprites, Pixels& indices);
+};
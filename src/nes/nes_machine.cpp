@@ -1,8 +1,12 @@
 #include "nes_machine.h"
 #include "nes_ppu.h"
 #include "src/cpu/cpu_6502.h"
+#include "src/cpu/cpu_6502_histogram.h"
+#include "src/cpu/bus_profiler.h"
 #include "src/cpu/address_space.h"
-#include "src/nes/nes_mapper.h"
+#include "src/nes/nes_cheats.h"
+#include "src/nes/nes_dma.h"
+#include "src/nes/nes_mappers.h"
 #include "src/nes/nes_rom.h"
 
 #include <halley.hpp>
@@ -52,28 +56,43 @@ NESMachine::NESMachine()
 
 	ppuAddressSpace = std::make_unique<AddressSpace8BitBy16Bit>();
 	vram.resize(2 * 1024, 0);
-	paletteRam.resize(32, 0);
 	ppuAddressSpace->map(gsl::span<uint8_t>(vram), 0x2000, 0x3EFF);
-	ppuAddressSpace->map(paletteRam, 0x3F00, 0x3FFF, 0x1F);
+
+	cheats = std::make_unique<NESCheats>(*cpuAddressSpace);
 
 	cpu = std::make_unique<CPU6502>();
 	cpu->setAddressSpace(*cpuAddressSpace);
+	cpu->setDirectRAM(ram.data());
 
 	ppu = std::make_unique<NESPPU>();
-	ppu->mapRegistersOnCPUAddressSpace(*cpuAddressSpace);
 	ppu->setAddressSpace(*ppuAddressSpace);
 	ppu->setFrameBuffer(frameBuffer);
 
 	apu = std::make_unique<NESAPU>();
 
-	cpuAddressSpace->mapRegister(0x4000, 0x401F, this, [] (void* self, uint16_t address, uint8_t& value, bool write)
+	dma = std::make_unique<NESDMA>(*cpu, *cpuAddressSpace);
+
+	cpuAddressSpace->mapReadRegister<&NESMachine::readPPURegister>(0x2000, 0x3FFF, *this);
+	cpuAddressSpace->mapReadRegister<&NESMachine::readRegister>(0x4000, 0x401F, *this);
+	cpuAddressSpace->mapWriteRegister<&NESMachine::writeRegister>(0x4000, 0x401F, *this);
+
+	// Lets the CPU skip ahead through loops polling $2002, up to the next time the PPU could change its answer
+	cpu->setPollHorizonCallback(this, [] (void* self, uint16_t address, uint64_t sinceCycle) -> uint64_t
 	{
 		const auto machine = static_cast<NESMachine*>(self);
-		if (write) {
-			machine->writeRegister(address, value);
-		} else {
-			value = machine->readRegister(address);
+		if (address >= 0x2000 && address < 0x4000 && (address & 0x0F) == 0x02 && machine->ppu->getStatusChangeCycle() < sinceCycle * 3) {
+			return machine->ppu->getNextStatusChangeCycle() / 3 + 1;
 		}
+		return 0;
+	});
+
+	cpuAddressSpace->setBreakpointHandler(this, [] (void* self, uint16_t address, uint8_t value, bool write)
+	{
+		static_cast<NESMachine*>(self)->onBreakpoint("CPU", address, value, write);
+	});
+	ppuAddressSpace->setBreakpointHandler(this, [] (void* self, uint16_t address, uint8_t value, bool write)
+	{
+		static_cast<NESMachine*>(self)->onBreakpoint("PPU", address, value, write);
 	});
 }
 
@@ -82,68 +101,246 @@ NESMachine::~NESMachine() = default;
 void NESMachine::loadROM(std::unique_ptr<NESRom> romToLoad)
 {
 	rom = std::move(romToLoad);
-	mapper = std::make_unique<NESMapper>();
-	if (!mapper->map(*rom, *cpuAddressSpace, *ppuAddressSpace)) {
+	const bool supported = visitNESMapperType(rom->getMapper(), [&] (auto type)
+	{
+		loadMapper<typename decltype(type)::Type>();
+	});
+	if (!supported) {
 		Logger::logError("Unknown mapper: " + toString(rom->getMapper()));
+		return;
 	}
+
 	cpu->raiseReset();
+	scheduleVBlank();
 	running = true;
 }
 
+template <typename T>
+void NESMachine::loadMapper()
+{
+	mapper = std::make_unique<T>();
+	mapper->setIRQCallback(this, [] (void* self)
+	{
+		static_cast<NESMachine*>(self)->onMapperIRQChanged<T>();
+	});
+	mapper->map(*rom, *cpuAddressSpace, *ppuAddressSpace, vram);
+
+	cpuAddressSpace->mapWriteRegister<&NESMachine::writePPURegister<T>>(0x2000, 0x3FFF, *this);
+	cpuAddressSpace->mapWriteRegister<&NESMachine::writeMapperRegister<T>>(0x8000, 0xFFFF, *this);
+	if constexpr (T::hasScanlineCounter) {
+		ppu->setScanlineCallback(mapper.get(), [] (void* mapper)
+		{
+			static_cast<T*>(mapper)->onScanline();
+		});
+	}
+
+	runFrameFunction = &NESMachine::runFrame<T>;
+}
+
 void NESMachine::tickFrame(gsl::span<const NESInputJoystick> joysticks)
 {
-	while (running) {
-		// Step APU first, have it catch up to CPU
-		const auto targetAPUCycle = cpu->getCycle() / 2;
-		while (apu->getCycle() < targetAPUCycle) {
-			apu->tick();
-		}
-		
-		// Step PPU next, have it also catch up to CPU
-		const auto targetPPUCycle = cpu->getCycle() * 3;
-		while (ppu->getCycle() < targetPPUCycle) {
-			const bool vsync = ppu->tick();
-			if (vsync) {
-				// If we finish a frame, stop here and render it out before continuing
-				if (ppu->canGenerateNMI()) {
-					cpu->raiseNMI();
-				}
+	joystickBits[0] = joysticks[0].toBits();
+	joystickBits[1] = joysticks[1].toBits();
+	latchInput();
+	cheats->applyFreezes();
 
-				//Logger::logInfo("Frame " + toString(ppu->getFrameNumber()) + ": " + toString(cpu->getCycle() - startCPU) + ", total: " + toString(cpu->getCycle()) + ", average: " + toString(cpu->getCycle() / (ppu->getFrameNumber() + 1)));
-				return;
-			}
-		}
+	cpu->clearBreakpointHit();
+	if (running) {
+		(this->*runFrameFunction)();
+	}
+}
 
-		// Tick CPU
+template <typename T>
+void NESMachine::runFrame()
+{
+	while (running) {
+		// Run the CPU in one go up to the next event; the APU and PPU only catch up when something needs them to
 		//cpu->printDebugInfo();
-		cpu->tick();
+		cpu->runUntil(scheduler.getNextEventCycle());
 		if (cpu->hasError()) {
 			running = false;
 			reportCPUError();
 			return;
 		}
+		if (cpu->hasHitBreakpoint()) {
+			Logger::logInfo("Stopped at breakpoint, PC = $" + toString(int(cpu->getPC()), 16, 4).asciiUpper());
+			return;
+		}
 
-		// Latch input
-		if (inputLatch & 1) {
-			port0 = joysticks[0].toBits();
-			port1 = joysticks[1].toBits();
+		NESEvent event;
+		while (scheduler.popDueEvent(cpu->getCycle(), event)) {
+			if (handleEvent<T>(event)) {
+				if (busProfilingPerFrame && cpuBusProfiler) {
+					Logger::logInfo("Frame " + toString(ppu->getFrameNumber()) + ":");
+					logBusProfile();
+				}
+				return;
+			}
 		}
 	}
 }
 
+template <typename T>
+bool NESMachine::handleEvent(NESEvent event)
+{
+	// Returns true when the frame is done
+	switch (event) {
+	case NESEvent::VBlank:
+		if (!catchUp(cpu->getCycle())) {
+			// Can't happen unless the PPU's timing changed under us
+			scheduleVBlank();
+			return false;
+		}
+
+		// Stop here and render the frame out before continuing
+		if (ppu->canGenerateNMI()) {
+			cpu->raiseNMI();
+		}
+		scheduleVBlank();
+
+		//Logger::logInfo("Frame " + toString(ppu->getFrameNumber()) + ": " + toString(cpu->getCycle() - startCPU) + ", total: " + toString(cpu->getCycle()) + ", average: " + toString(cpu->getCycle() / (ppu->getFrameNumber() + 1)));
+		return true;
+
+	case NESEvent::MapperIRQ:
+		catchUp(cpu->getCycle());
+		updateIRQLine();
+		scheduleMapperIRQ<T>();
+		return false;
+
+	case NESEvent::DMCFetch:
+		// Catching up empties the DMC's buffer if it was due to, which is what makes the fetch due
+		catchUp(cpu->getCycle());
+		if (apu->getNextDMCFetchCycle() <= cpu->getCycle()) {
+			apu->onDMCFetch(dma->runDMCFetch(apu->getDMCFetchAddress()));
+			updateIRQLine();
+		}
+		scheduleDMCFetch();
+		return false;
+
+	default:
+		return false;
+	}
+}
+
+void NESMachine::scheduleVBlank()
+{
+	// The first instruction that would start after the PPU flags vblank
+	const auto vblankDot = ppu->getNextVBlankCycle() - 1;
+	scheduler.schedule(NESEvent::VBlank, vblankDot / 3 + 1);
+}
+
+void NESMachine::scheduleDMCFetch()
+{
+	const uint64_t fetchCycle = apu->getNextDMCFetchCycle();
+	if (fetchCycle == NESAPU::noDMCFetch) {
+		scheduler.cancel(NESEvent::DMCFetch);
+		return;
+	}
+
+	// The current run might have been given a later deadline
+	scheduler.schedule(NESEvent::DMCFetch, fetchCycle);
+	cpu->stopRun();
+}
+
+template <typename T>
+void NESMachine::scheduleMapperIRQ()
+{
+	// Predicts when the scanline counter runs out. PPUMASK writes and mapper writes can change that, so they reschedule.
+	const uint32_t scanlines = static_cast<const T&>(*mapper).getScanlinesUntilIRQ();
+	const uint64_t clockDot = scanlines == NESMapper::noIRQ ? NESScheduler::never : ppu->getScanlineClockCycle(scanlines);
+	if (clockDot == NESScheduler::never) {
+		scheduler.cancel(NESEvent::MapperIRQ);
+		return;
+	}
+
+	// The current run might have been given a later deadline
+	scheduler.schedule(NESEvent::MapperIRQ, clockDot / 3 + 1);
+	cpu->stopRun();
+}
+
+template <typename T>
+void NESMachine::onMapperIRQChanged()
+{
+	if (mapper->isIRQAsserted()) {
+		// Only raise it between instructions
+		scheduler.schedule(NESEvent::MapperIRQ, cpu->getCycle());
+		cpu->stopRun();
+	} else {
+		updateIRQLine();
+		scheduleMapperIRQ<T>();
+	}
+}
+
+void NESMachine::updateIRQLine()
+{
+	// The cartridge and the DMC share the IRQ line
+	cpu->setIRQLine(mapper->isIRQAsserted() || apu->isDMCIRQAsserted());
+}
+
+bool NESMachine::catchUp(uint64_t cpuCycle)
+{
+	// Step APU first
+	apu->runUntil(cpuCycle / 2);
+
+	// Step PPU next, returns true when it reaches vblank
+	return ppu->runUntil(cpuCycle * 3);
+}
+
+void NESMachine::latchInput()
+{
+	// While the strobe is high, the controllers keep reloading their shift registers
+	if (inputLatch & 1) {
+		port0 = joystickBits[0];
+		port1 = joystickBits[1];
+	}
+}
+
+uint8_t NESMachine::readPPURegister(uint16_t address)
+{
+	// The CPU runs ahead of the PPU and APU, so bring them up to date before they see any register access
+	catchUp(cpu->getInstructionStartCycle());
+	return ppu->readRegister(0x2000 | (address & 0x0F));
+}
+
+template <typename T>
+void NESMachine::writePPURegister(uint16_t address, uint8_t value)
+{
+	catchUp(cpu->getInstructionStartCycle());
+	ppu->writeRegister(0x2000 | (address & 0x0F), value);
+
+	// Turning rendering on or off starts or stops the scanline counter
+	if constexpr (T::hasScanlineCounter) {
+		if ((address & 0x0F) == 0x01) {
+			scheduleMapperIRQ<T>();
+		}
+	}
+}
+
+template <typename T>
+void NESMachine::writeMapperRegister(uint16_t address, uint8_t value)
+{
+	// Bank switches and scanline counter changes mustn't affect anything the PPU has yet to catch up on
+	catchUp(cpu->getInstructionStartCycle());
+	static_cast<T&>(*mapper).writeRegister(address, value);
+}
+
 uint8_t NESMachine::readRegister(uint16_t address)
 {
+	catchUp(cpu->getInstructionStartCycle());
+
 	switch (address) {
 	case 0x4015:
 		return apu->readRegister(address);
 	case 0x4016:
 		{
+			latchInput();
 			const uint8_t value = (port0 & 1);
 			port0 = (port0 >> 1) | 0x80;
 			return value;
 		}
 	case 0x4017:
 		{
+			latchInput();
 			const uint8_t value = (port1 & 1);
 			port1 = (port1 >> 1) | 0x80;
 			return value;
@@ -155,17 +352,25 @@ uint8_t NESMachine::readRegister(uint16_t address)
 
 void NESMachine::writeRegister(uint16_t address, uint8_t value)
 {
+	catchUp(cpu->getInstructionStartCycle());
+
 	switch (address) {
 	case 0x4014:
 		// OAMDMA
-		cpu->copyOAM(value, ppu->getOAMData());
+		dma->runOAMDMA(value, ppu->getOAMData());
 		break;
 	case 0x4016:
 		// JOY1
 	    inputLatch = value & 0x7;
+	    latchInput();
 	    break;
 	default:
 		apu->writeRegister(address, value);
+		if ((address >= 0x4010 && address <= 0x4013) || address == 0x4015) {
+			// Starting, stopping or acknowledging the DMC
+			scheduleDMCFetch();
+			updateIRQLine();
+		}
 		break;
 	}
 }
@@ -180,6 +385,114 @@ gsl::span<const float> NESMachine::getAudioBuffer() const
 	return audioBuffer;
 }
 
+AddressSpace8BitBy16Bit& NESMachine::getCPUAddressSpace()
+{
+	return *cpuAddressSpace;
+}
+
+AddressSpace8BitBy16Bit& NESMachine::getPPUAddressSpace()
+{
+	return *ppuAddressSpace;
+}
+
+bool NESMachine::addCheat(std::string_view code)
+{
+	const auto cheat = NESCheats::parse(code);
+	if (!cheat) {
+		Logger::logWarning("Invalid cheat: " + String(std::string(code)));
+		return false;
+	}
+	cheats->add(*cheat);
+	return true;
+}
+
+void NESMachine::clearCheats()
+{
+	cheats->clear();
+}
+
+CPU6502& NESMachine::getCPU()
+{
+	return *cpu;
+}
+
+bool NESMachine::isAtBreakpoint() const
+{
+	return cpu->hasHitBreakpoint();
+}
+
+void NESMachine::onBreakpoint(const char* bus, uint16_t address, uint8_t value, bool write)
+{
+	// Stops once the current instruction is done
+	Logger::logInfo(String(bus) + (write ? " write $" : " read $") + toString(int(address), 16, 4).asciiUpper()
+		+ (write ? " <- $" : " -> $") + toString(int(value), 16, 2).asciiUpper());
+	cpu->hitBreakpoint();
+}
+
+void NESMachine::setPairHistogramEnabled(bool enabled)
+{
+	if (enabled == isPairHistogramEnabled()) {
+		return;
+	}
+
+	if (enabled) {
+		pairHistogram = std::make_unique<CPU6502PairHistogram>();
+		cpu->setPairHistogram(pairHistogram.get());
+	} else {
+		cpu->setPairHistogram(nullptr);
+		pairHistogram->log(32);
+		pairHistogram.reset();
+	}
+}
+
+bool NESMachine::isPairHistogramEnabled() const
+{
+	return static_cast<bool>(pairHistogram);
+}
+
+void NESMachine::setBusProfilingEnabled(bool enabled, bool perFrame)
+{
+#ifdef EMUND_BUS_PROFILING
+	if (enabled == isBusProfilingEnabled()) {
+		return;
+	}
+
+	if (enabled) {
+		busProfilingPerFrame = perFrame;
+		cpuBusProfiler = std::make_unique<BusProfiler>();
+		ppuBusProfiler = std::make_unique<BusProfiler>();
+		cpuAddressSpace->setProfiler(cpuBusProfiler.get());
+		ppuAddressSpace->setProfiler(ppuBusProfiler.get());
+	} else {
+		cpuAddressSpace->setProfiler(nullptr);
+		ppuAddressSpace->setProfiler(nullptr);
+		if (!busProfilingPerFrame) {
+			logBusProfile();
+		}
+		cpuBusProfiler.reset();
+		ppuBusProfiler.reset();
+	}
+#else
+	(void)perFrame;
+	if (enabled) {
+		Logger::logWarning("Bus profiling needs a build with EMUND_BUS_PROFILING");
+	}
+#endif
+}
+
+bool NESMachine::isBusProfilingEnabled() const
+{
+	return static_cast<bool>(cpuBusProfiler);
+}
+
+void NESMachine::logBusProfile()
+{
+	cpuBusProfiler->log("CPU", 16);
+	ppuBusProfiler->log("PPU", 16);
+	cpuBusProfiler->clear();
+	ppuBusProfiler->clear();
+}
+
 void NESMachine::reportCPUError()
 {
 	switch (cpu->getError()) {
@@ -1,13 +1,21 @@
 #pragma once
+#include <array>
 #include <memory>
+#include <string_view>
 #include <vector>
 #include <gsl/span>
 
+#include "nes_scheduler.h"
+
 class NESRom;
 class NESMapper;
+class NESCheats;
 class CPU6502;
+class CPU6502PairHistogram;
+class BusProfiler;
 class NESPPU;
 class NESAPU;
+class NESDMA;
 class AddressSpace8BitBy16Bit;
 
 struct NESInputJoystick {
@@ -25,6 +33,8 @@ struct NESInputJoystick {
 	void clear();
 };
 
+// Everything between the CPU bus and the mapper is instantiated for each mapper type in loadROM, so register writes,
+// scanline clocks and IRQ scheduling call the mapper directly
 class NESMachine {
 public:
 	NESMachine();
@@ -39,29 +49,79 @@ public:
 	gsl::span<const uint32_t> getFrameBuffer() const;
 	gsl::span<const float> getAudioBuffer() const;
 
+	// Game Genie codes, or raw AAAA:VV / AAAA?CC:VV patches. Returns false if the code can't be parsed.
+	bool addCheat(std::string_view code);
+	void clearCheats();
+
+	// For snapshots, which can use their dirty pages to only look at what changed, and for setting breakpoints
+	AddressSpace8BitBy16Bit& getCPUAddressSpace();
+	AddressSpace8BitBy16Bit& getPPUAddressSpace();
+	CPU6502& getCPU();
+
+	// A frame stops early when it hits a breakpoint. The next tickFrame carries on from there.
+	bool isAtBreakpoint() const;
+
+	// Records which instruction follows which (slowly), and logs the most common pairs once disabled
+	void setPairHistogramEnabled(bool enabled);
+	bool isPairHistogramEnabled() const;
+
+	// Counts CPU and PPU bus traffic (slowly), and logs it at the end of every frame or once disabled, as picked when
+	// enabling it.
+	// Needs EMUND_BUS_PROFILING.
+	void setBusProfilingEnabled(bool enabled, bool perFrame = false);
+	bool isBusProfilingEnabled() const;
+
 private:
+	using RunFrameFunction = void (NESMachine::*)();
+
 	bool running = false;
+	RunFrameFunction runFrameFunction = nullptr;
 	
 	std::unique_ptr<NESRom> rom;
 	std::unique_ptr<NESMapper> mapper;
 	std::unique_ptr<CPU6502> cpu;
 	std::unique_ptr<NESPPU> ppu;
 	std::unique_ptr<NESAPU> apu;
+	std::unique_ptr<NESDMA> dma;
 	std::unique_ptr<AddressSpace8BitBy16Bit> cpuAddressSpace;
 	std::unique_ptr<AddressSpace8BitBy16Bit> ppuAddressSpace;
+	std::unique_ptr<NESCheats> cheats;
+	std::unique_ptr<CPU6502PairHistogram> pairHistogram;
+	std::unique_ptr<BusProfiler> cpuBusProfiler;
+	std::unique_ptr<BusProfiler> ppuBusProfiler;
+	bool busProfilingPerFrame = false;
 	std::vector<uint8_t> ram;
 	std::vector<uint8_t> vram;
-	std::vector<uint8_t> paletteRam;
 
 	std::vector<uint32_t> frameBuffer;
 	std::vector<float> audioBuffer;
 
+	std::array<uint8_t, 2> joystickBits = {};
 	uint8_t inputLatch = 0;
 	uint8_t port0 = 0;
 	uint8_t port1 = 0;
 
 	size_t nFrames;
 
+	NESScheduler scheduler;
+
+	template <typename T> void loadMapper();
+	template <typename T> void runFrame();
+	template <typename T> bool handleEvent(NESEvent event);
+	template <typename T> void scheduleMapperIRQ();
+	template <typename T> void onMapperIRQChanged();
+
+	uint8_t readPPURegister(uint16_t address);
+	template <typename T> void writePPURegister(uint16_t address, uint8_t value);
+	template <typename T> void writeMapperRegister(uint16_t address, uint8_t value);
+
+	bool catchUp(uint64_t cpuCycle);
+	void scheduleVBlank();
+	void scheduleDMCFetch();
+	void updateIRQLine();
+	void logBusProfile();
+	void onBreakpoint(const char* bus, uint16_t address, uint8_t value, bool write);
+	void latchInput();
 	void reportCPUError();
 };
 
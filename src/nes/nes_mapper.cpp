@@ -2,20 +2,126 @@
 #include "nes_rom.h"
 #include "src/cpu/address_space.h"
 
-bool NESMapper::map(NESRom& rom, AddressSpace8BitBy16Bit& cpuAddressSpace, AddressSpace8BitBy16Bit& ppuAddressSpace)
+#include <algorithm>
+#include <array>
+
+NESMapper::~NESMapper() = default;
+
+void NESMapper::map(NESRom& rom, AddressSpace8BitBy16Bit& cpuAddressSpace, AddressSpace8BitBy16Bit& ppuAddressSpace, gsl::span<uint8_t> vram)
+{
+	this->cpuAddressSpace = &cpuAddressSpace;
+	this->ppuAddressSpace = &ppuAddressSpace;
+	this->vram = vram;
+
+	prg = rom.getPRGROM();
+	chr = rom.getCHRROM();
+	chrIsRAM = chr.empty();
+	if (chrIsRAM) {
+		chrRAM.resize(chrRAMSize, 0);
+		chr = chrRAM;
+	}
+
+	prgRAM.resize(prgRAMSize, 0);
+	cpuAddressSpace.map(prgRAM, 0x6000, 0x7FFF);
+	if (!chrIsRAM) {
+		ppuAddressSpace.mapWriteRegister<&NESMapper::ignoreWrite>(0x0000, 0x1FFF, *this);
+	}
+
+	fourScreen = rom.getMirroring() == NESMirroring::FourScreen;
+	if (fourScreen) {
+		fourScreenVRAM.resize(2 * 1024, 0);
+	}
+	setMirroring(rom.getMirroring());
+	reset();
+}
+
+void NESMapper::setIRQCallback(void* data, Callback irqChanged)
+{
+	callbackData = data;
+	irqChangedCallback = irqChanged;
+}
+
+void NESMapper::onScanline()
+{
+}
+
+uint32_t NESMapper::getScanlinesUntilIRQ() const
+{
+	return noIRQ;
+}
+
+bool NESMapper::isIRQAsserted() const
 {
-	switch (rom.getMapper()) {
-	case 0:
-		mapper0(rom, cpuAddressSpace, ppuAddressSpace);
-		return true;
+	return irqAsserted;
+}
+
+void NESMapper::mapPRG(uint16_t address, size_t size, int bank)
+{
+	const size_t nBanks = std::max(size_t(1), prg.size() / size);
+	const size_t index = (bank < 0 ? nBanks - size_t(-bank) % nBanks : size_t(bank)) % nBanks;
+	cpuAddressSpace->map(prg.subspan(index * size, std::min(size, prg.size())), address, uint16_t(address + size - 1));
+}
+
+void NESMapper::mapCHR(uint16_t address, size_t size, int bank)
+{
+	const size_t nBanks = std::max(size_t(1), chr.size() / size);
+	const size_t index = (bank < 0 ? nBanks - size_t(-bank) % nBanks : size_t(bank)) % nBanks;
+	ppuAddressSpace->map(chr.subspan(index * size, std::min(size, chr.size())), address, uint16_t(address + size - 1));
+}
+
+void NESMapper::setMirroring(NESMirroring mirroring)
+{
+	// Four-screen carts wire the nametables up themselves, whatever the mapper says
+	if (fourScreen) {
+		mirroring = NESMirroring::FourScreen;
+	}
 
-	default:
-		return false;
+	// Which 1 KB of vram each of the four nametables shows, 2 and 3 being the cartridge's
+	std::array<size_t, 4> nametables;
+	switch (mirroring) {
+	case NESMirroring::Horizontal:
+		nametables = { 0, 0, 1, 1 };
+		break;
+	case NESMirroring::Vertical:
+		nametables = { 0, 1, 0, 1 };
+		break;
+	case NESMirroring::SingleScreenLower:
+		nametables = { 0, 0, 0, 0 };
+		break;
+	case NESMirroring::SingleScreenUpper:
+		nametables = { 1, 1, 1, 1 };
+		break;
+	case NESMirroring::FourScreen:
+		nametables = { 0, 1, 2, 3 };
+		break;
+	}
+
+	// $3000-$3EFF mirrors $2000-$2EFF
+	for (size_t i = 0; i < 4; ++i) {
+		const auto nametable = nametables[i] < 2
+			? vram.subspan(nametables[i] * 0x400, 0x400)
+			: gsl::span<uint8_t>(fourScreenVRAM).subspan((nametables[i] - 2) * 0x400, 0x400);
+		const uint16_t address = uint16_t(0x2000 + i * 0x400);
+		ppuAddressSpace->map(nametable, address, address + 0x3FF);
+		ppuAddressSpace->map(nametable, address + 0x1000, uint16_t(std::min(address + 0x13FF, 0x3EFF)));
+	}
+}
+
+void NESMapper::setIRQAsserted(bool asserted)
+{
+	if (irqAsserted != asserted) {
+		irqAsserted = asserted;
+		notifyIRQChanged();
+	}
+}
+
+void NESMapper::notifyIRQChanged()
+{
+	if (irqChangedCallback) {
+		irqChangedCallback(callbackData);
 	}
 }
 
-void NESMapper::mapper0(NESRom& rom, AddressSpace8BitBy16Bit& cpuAddressSpace, AddressSpace8BitBy16Bit& ppuAddressSpace)
+void NESMapper::ignoreWrite(uint16_t address, uint8_t value)
 {
-	cpuAddressSpace.map(rom.getPRGROM(), 0x8000, 0xFFFF);
-	ppuAddressSpace.map(rom.getCHRROM(), 0x0000, 0x1FFF);	
 }
@@ -1,12 +1,66 @@
 #pragma once
+#include <cstdint>
+#include <vector>
+#include <gsl/span>
 
 class AddressSpace8BitBy16Bit;
 class NESRom;
+enum class NESMirroring : uint8_t;
 
+// Cartridge hardware. Banks are switched by pointing address space pages at different parts of the ROM, so a switch
+// never copies anything. ROM pages are read-only: whoever owns the CPU address space forwards writes to $8000-$FFFF
+// to writeRegister, after syncing anything that a bank switch could affect.
+// The concrete mappers are final, so code that knows which one it's dealing with (see visitNESMapperType) gets
+// direct calls to them.
 class NESMapper {
 public:
-	bool map(NESRom& rom, AddressSpace8BitBy16Bit& cpuAddressSpace, AddressSpace8BitBy16Bit& ppuAddressSpace);
+	using Callback = void(*)(void*);
+	constexpr static uint32_t noIRQ = UINT32_MAX;
+
+	virtual ~NESMapper();
+
+	void map(NESRom& rom, AddressSpace8BitBy16Bit& cpuAddressSpace, AddressSpace8BitBy16Bit& ppuAddressSpace, gsl::span<uint8_t> vram);
+
+	// Called whenever the IRQ line or the scanline counter changed
+	void setIRQCallback(void* data, Callback irqChanged);
+
+	virtual void writeRegister(uint16_t address, uint8_t value) = 0;
+
+	// Scanline IRQ counter (MMC3), clocked by the PPU once per rendered scanline
+	constexpr static bool hasScanlineCounter = false;
+	virtual void onScanline();
+	virtual uint32_t getScanlinesUntilIRQ() const; // Counting the next onScanline() as 1, or noIRQ
+	bool isIRQAsserted() const;
+
+protected:
+	constexpr static size_t prgRAMSize = 8 * 1024;
+	constexpr static size_t chrRAMSize = 8 * 1024;
+
+	gsl::span<uint8_t> prg;
+	gsl::span<uint8_t> chr;
+	bool chrIsRAM = false;
+	bool irqAsserted = false;
+
+	// Negative banks count from the end, e.g. -1 is the last one
+	void mapPRG(uint16_t address, size_t size, int bank);
+	void mapCHR(uint16_t address, size_t size, int bank);
+	void setMirroring(NESMirroring mirroring);
+	void setIRQAsserted(bool asserted);
+	void notifyIRQChanged();
+
+	virtual void reset() = 0;
 
 private:
-	void mapper0(NESRom& rom, AddressSpace8BitBy16Bit& cpuAddressSpace, AddressSpace8BitBy16Bit& ppuAddressSpace);
+	AddressSpace8BitBy16Bit* cpuAddressSpace = nullptr;
+	AddressSpace8BitBy16Bit* ppuAddressSpace = nullptr;
+	gsl::span<uint8_t> vram;
+	std::vector<uint8_t> prgRAM;
+	std::vector<uint8_t> chrRAM;
+	std::vector<uint8_t> fourScreenVRAM; // The cartridge's own 2 KB, for the third and fourth nametables
+	bool fourScreen = false;
+
+	void* callbackData = nullptr;
+	Callback irqChangedCallback = nullptr;
+
+	void ignoreWrite(uint16_t address, uint8_t value);
 };
@@ -0,0 +1,229 @@
+#include "nes_mappers.h"
+#include "nes_rom.h"
+
+namespace {
+	constexpr size_t kb = 1024;
+}
+
+void NESMapperNROM::reset()
+{
+	mapPRG(0x8000, 32 * kb, 0);
+	mapCHR(0x0000, 8 * kb, 0);
+}
+
+void NESMapperNROM::writeRegister(uint16_t address, uint8_t value)
+{
+}
+
+void NESMapperMMC1::reset()
+{
+	shiftRegister = 0;
+	shiftCount = 0;
+	control = 0x0C;
+	chrBank0 = 0;
+	chrBank1 = 0;
+	prgBank = 0;
+	updateBanks();
+}
+
+void NESMapperMMC1::writeRegister(uint16_t address, uint8_t value)
+{
+	if (value & 0x80) {
+		shiftRegister = 0;
+		shiftCount = 0;
+		control |= 0x0C;
+		updateBanks();
+		return;
+	}
+
+	// Bits come in LSB first, and the fifth write picks the register by its address
+	shiftRegister |= (value & 1) << shiftCount;
+	if (++shiftCount < 5) {
+		return;
+	}
+
+	switch ((address >> 13) & 3) {
+	case 0:
+		control = shiftRegister;
+		break;
+	case 1:
+		chrBank0 = shiftRegister;
+		break;
+	case 2:
+		chrBank1 = shiftRegister;
+		break;
+	case 3:
+		prgBank = shiftRegister;
+		break;
+	}
+	shiftRegister = 0;
+	shiftCount = 0;
+	updateBanks();
+}
+
+void NESMapperMMC1::updateBanks()
+{
+	constexpr NESMirroring mirrorings[] = { NESMirroring::SingleScreenLower, NESMirroring::SingleScreenUpper, NESMirroring::Vertical, NESMirroring::Horizontal };
+	setMirroring(mirrorings[control & 3]);
+
+	// 512 KB boards (SUROM) use a CHR bank bit to pick which 256 KB half of PRG the other banks are in
+	const int outerBank = prg.size() > 256 * kb ? (chrBank0 & 0x10) : 0;
+	const int bank = prgBank & 0x0F;
+	switch ((control >> 2) & 3) {
+	case 0:
+	case 1:
+		mapPRG(0x8000, 16 * kb, outerBank | (bank & ~1));
+		mapPRG(0xC000, 16 * kb, outerBank | (bank | 1));
+		break;
+	case 2:
+		mapPRG(0x8000, 16 * kb, outerBank);
+		mapPRG(0xC000, 16 * kb, outerBank | bank);
+		break;
+	case 3:
+		mapPRG(0x8000, 16 * kb, outerBank | bank);
+		mapPRG(0xC000, 16 * kb, outerBank | 0x0F);
+		break;
+	}
+
+	if (control & 0x10) {
+		mapCHR(0x0000, 4 * kb, chrBank0);
+		mapCHR(0x1000, 4 * kb, chrBank1);
+	} else {
+		mapCHR(0x0000, 4 * kb, chrBank0 & ~1);
+		mapCHR(0x1000, 4 * kb, chrBank0 | 1);
+	}
+}
+
+void NESMapperUxROM::reset()
+{
+	mapPRG(0x8000, 16 * kb, 0);
+	mapPRG(0xC000, 16 * kb, -1);
+	mapCHR(0x0000, 8 * kb, 0);
+}
+
+void NESMapperUxROM::writeRegister(uint16_t address, uint8_t value)
+{
+	mapPRG(0x8000, 16 * kb, value);
+}
+
+void NESMapperCNROM::reset()
+{
+	mapPRG(0x8000, 32 * kb, 0);
+	mapCHR(0x0000, 8 * kb, 0);
+}
+
+void NESMapperCNROM::writeRegister(uint16_t address, uint8_t value)
+{
+	mapCHR(0x0000, 8 * kb, value);
+}
+
+void NESMapperMMC3::onScanline()
+{
+	if (irqCounter == 0 || irqReload) {
+		irqCounter = irqLatch;
+		irqReload = false;
+	} else {
+		--irqCounter;
+	}
+
+	if (irqCounter == 0 && irqEnabled) {
+		setIRQAsserted(true);
+	}
+}
+
+uint32_t NESMapperMMC3::getScanlinesUntilIRQ() const
+{
+	if (!irqEnabled) {
+		return noIRQ;
+	}
+	if (irqCounter == 0 || irqReload) {
+		// The next clock reloads it, and a latch of zero fires on every clock
+		return irqLatch == 0 ? 1 : uint32_t(irqLatch) + 1;
+	}
+	return irqCounter;
+}
+
+void NESMapperMMC3::reset()
+{
+	bankSelect = 0;
+	banks = { 0, 2, 4, 5, 6, 7, 0, 1 };
+	irqLatch = 0;
+	irqCounter = 0;
+	irqReload = false;
+	irqEnabled = false;
+	updateBanks();
+}
+
+void NESMapperMMC3::writeRegister(uint16_t address, uint8_t value)
+{
+	// Registers are picked by the top three bits and whether the address is even or odd
+	switch (address & 0xE001) {
+	case 0x8000:
+		bankSelect = value;
+		updateBanks();
+		break;
+	case 0x8001:
+		banks[bankSelect & 7] = value;
+		updateBanks();
+		break;
+	case 0xA000:
+		setMirroring(value & 1 ? NESMirroring::Horizontal : NESMirroring::Vertical);
+		break;
+	case 0xA001:
+		// PRG RAM protect, always left enabled
+		break;
+	case 0xC000:
+		irqLatch = value;
+		notifyIRQChanged();
+		break;
+	case 0xC001:
+		irqCounter = 0;
+		irqReload = true;
+		notifyIRQChanged();
+		break;
+	case 0xE000:
+		irqEnabled = false;
+		irqAsserted = false;
+		notifyIRQChanged();
+		break;
+	case 0xE001:
+		irqEnabled = true;
+		notifyIRQChanged();
+		break;
+	}
+}
+
+void NESMapperMMC3::updateBanks()
+{
+	if (bankSelect & 0x40) {
+		mapPRG(0x8000, 8 * kb, -2);
+		mapPRG(0xC000, 8 * kb, banks[6] & 0x3F);
+	} else {
+		mapPRG(0x8000, 8 * kb, banks[6] & 0x3F);
+		mapPRG(0xC000, 8 * kb, -2);
+	}
+	mapPRG(0xA000, 8 * kb, banks[7] & 0x3F);
+	mapPRG(0xE000, 8 * kb, -1);
+
+	// The two 2 KB banks and the four 1 KB banks swap pattern tables when bit 7 is set
+	const uint16_t inversion = (bankSelect & 0x80) ? 0x1000 : 0x0000;
+	mapCHR(0x0000 ^ inversion, 2 * kb, banks[0] >> 1);
+	mapCHR(0x0800 ^ inversion, 2 * kb, banks[1] >> 1);
+	mapCHR(0x1000 ^ inversion, 1 * kb, banks[2]);
+	mapCHR(0x1400 ^ inversion, 1 * kb, banks[3]);
+	mapCHR(0x1800 ^ inversion, 1 * kb, banks[4]);
+	mapCHR(0x1C00 ^ inversion, 1 * kb, banks[5]);
+}
+
+void NESMapperAxROM::reset()
+{
+	mapPRG(0x8000, 32 * kb, 0);
+	mapCHR(0x0000, 8 * kb, 0);
+	setMirroring(NESMirroring::SingleScreenLower);
+}
+
+void NESMapperAxROM::writeRegister(uint16_t address, uint8_t value)
+{
+	mapPRG(0x8000, 32 * kb, value & 0x07);
+	setMirroring(value & 0x10 ? NESMirroring::SingleScreenUpper : NESMirroring::SingleScreenLower);
+}
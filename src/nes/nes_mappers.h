@@ -0,0 +1,117 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+#include "nes_mapper.h"
+
+// Mapper 0: no banking
+class NESMapperNROM final : public NESMapper {
+public:
+	void writeRegister(uint16_t address, uint8_t value) override;
+
+protected:
+	void reset() override;
+};
+
+// Mapper 1: serial port into four 5-bit registers
+class NESMapperMMC1 final : public NESMapper {
+public:
+	void writeRegister(uint16_t address, uint8_t value) override;
+
+protected:
+	void reset() override;
+
+private:
+	uint8_t shiftRegister = 0;
+	uint8_t shiftCount = 0;
+	uint8_t control = 0x0C;
+	uint8_t chrBank0 = 0;
+	uint8_t chrBank1 = 0;
+	uint8_t prgBank = 0;
+
+	void updateBanks();
+};
+
+// Mapper 2: 16 KB switchable PRG bank at $8000, last bank fixed at $C000
+class NESMapperUxROM final : public NESMapper {
+public:
+	void writeRegister(uint16_t address, uint8_t value) override;
+
+protected:
+	void reset() override;
+};
+
+// Mapper 3: 8 KB switchable CHR bank
+class NESMapperCNROM final : public NESMapper {
+public:
+	void writeRegister(uint16_t address, uint8_t value) override;
+
+protected:
+	void reset() override;
+};
+
+// Mapper 4: 8 KB PRG and 1/2 KB CHR banks, and a scanline IRQ counter
+class NESMapperMMC3 final : public NESMapper {
+public:
+	constexpr static bool hasScanlineCounter = true;
+	void onScanline() override;
+	uint32_t getScanlinesUntilIRQ() const override;
+	void writeRegister(uint16_t address, uint8_t value) override;
+
+protected:
+	void reset() override;
+
+private:
+	uint8_t bankSelect = 0;
+	std::array<uint8_t, 8> banks = {};
+
+	uint8_t irqLatch = 0;
+	uint8_t irqCounter = 0;
+	bool irqReload = false;
+	bool irqEnabled = false;
+
+	void updateBanks();
+};
+
+// Mapper 7: 32 KB switchable PRG bank, single-screen mirroring
+class NESMapperAxROM final : public NESMapper {
+public:
+	void writeRegister(uint16_t address, uint8_t value) override;
+
+protected:
+	void reset() override;
+};
+
+template <typename T>
+struct NESMapperType {
+	using Type = T;
+};
+
+// Calls f with the NESMapperType of whichever class implements mapperNumber, so that it can be instantiated for it.
+// Returns false for unsupported mappers.
+template <typename F>
+bool visitNESMapperType(uint16_t mapperNumber, F&& f)
+{
+	switch (mapperNumber) {
+	case 0:
+		f(NESMapperType<NESMapperNROM>());
+		return true;
+	case 1:
+		f(NESMapperType<NESMapperMMC1>());
+		return true;
+	case 2:
+		f(NESMapperType<NESMapperUxROM>());
+		return true;
+	case 3:
+		f(NESMapperType<NESMapperCNROM>());
+		return true;
+	case 4:
+		f(NESMapperType<NESMapperMMC3>());
+		return true;
+	case 7:
+		f(NESMapperType<NESMapperAxROM>());
+		return true;
+	default:
+		return false;
+	}
+}
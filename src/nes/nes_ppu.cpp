@@ -1,7 +1,10 @@
 #include "nes_ppu.h"
+#include "nes_background_line.h"
+#include "nes_line_mixer.h"
 #include "src/cpu/address_space.h"
 
 #include <halley.hpp>
+#include <limits>
 
 #include "src/utils/bit_view.h"
 using namespace Halley;
@@ -54,6 +57,7 @@ using ShiftRegisterBottom = BitView<uint16_t, 0, 8>;
 NESPPU::NESPPU()
 {
 	ppuStatus = 0;
+	dirtyTiles.set();
 	oamData.resize(256, 0);
 	oamSecondaryData.resize(32, 0);
 }
@@ -74,8 +78,9 @@ bool NESPPU::tick()
 		}
 	}
 	
-	if (isPreRenderLine && curX == 1) {
+	if (isPreRenderLine && curX == 1 && (ppuStatus & (PPUSTATUS_SPRITE_ZERO_HIT | PPUSTATUS_VBLANK | PPUSTATUS_SPRITE_OVERFLOW))) {
 		ppuStatus &= ~(PPUSTATUS_SPRITE_ZERO_HIT | PPUSTATUS_VBLANK | PPUSTATUS_SPRITE_OVERFLOW);
+		statusChangeCycle = cycle;
 	}
 
 	if (isRendering()) {
@@ -93,6 +98,10 @@ bool NESPPU::tick()
 			RegisterNametableSelectX::of(vRegister).set(RegisterNametableSelectX::of(tRegister));
 		}
 
+		if (curX == 260 && scanlineCallback) {
+			scanlineCallback(scanlineCallbackData);
+		}
+
 		if (isPreRenderLine && curX >= 280 && curX <= 304) {
 			// Update vertical scroll
 			RegisterCoarseY::of(vRegister).set(RegisterCoarseY::of(tRegister));
@@ -112,6 +121,7 @@ bool NESPPU::tick()
 	// VBlank happens on the line after post-render
 	if (curY == 241 && curX == 1) {
 		ppuStatus |= PPUSTATUS_VBLANK;
+		statusChangeCycle = cycle - 1;
 		return true;
 	}
 
@@ -130,6 +140,27 @@ bool NESPPU::tick()
 	return false;
 }
 
+bool NESPPU::runUntil(uint64_t targetCycle)
+{
+	// Stops right after flagging vblank, returning true
+	busInstrumented = addressSpace->isInstrumented();
+	while (cycle < targetCycle) {
+#ifdef EMUND_PPU_SCANLINE_RENDERER
+		// Nothing can touch the PPU before targetCycle, so a visible line that fits entirely before it can be drawn
+		// in one go. Register writes, bank switches and $2002 reads all catch the PPU up to their own cycle first,
+		// which leaves the line they land in to tick().
+		if (curX == 0 && curY < 240 && cycle + 341 <= targetCycle && !busInstrumented) {
+			renderScanline();
+			continue;
+		}
+#endif
+		if (tick()) {
+			return true;
+		}
+	}
+	return false;
+}
+
 void NESPPU::incrementHorizontalPos()
 {
 	auto coarseX = RegisterCoarseX(vRegister);
@@ -170,27 +201,126 @@ bool NESPPU::canGenerateNMI() const
 	return ppuCtrl & PPUCTRL_GENERATE_NMI;
 }
 
+uint8_t NESPPU::getStatus() const
+{
+	return ppuStatus;
+}
+
+uint16_t NESPPU::getVRAMAddress() const
+{
+	return vRegister;
+}
+
+uint8_t NESPPU::getOAMAddress() const
+{
+	return oamAddr;
+}
+
 void NESPPU::setAddressSpace(AddressSpace8BitBy16Bit& addressSpace)
 {
 	this->addressSpace = &addressSpace;
 }
 
+void NESPPU::setScanlineCallback(void* data, void(*callback)(void*))
+{
+	scanlineCallbackData = data;
+	scanlineCallback = callback;
+}
+
 uint64_t NESPPU::getCycle() const
 {
 	return cycle;
 }
 
-void NESPPU::mapRegistersOnCPUAddressSpace(AddressSpace8BitBy16Bit& addressSpace)
+uint64_t NESPPU::getNextVBlankCycle() const
 {
-	addressSpace.mapRegister(0x2000, 0x3FFF, this, [] (void* self, uint16_t address, uint8_t& value, bool write)
-	{
-		const uint16_t realAddress = 0x2000 | (address & 0x0F);
-		if (write) {
-			static_cast<NESPPU*>(self)->writeRegister(realAddress, value);
+	// The cycle count right after the tick() that flags vblank, on dot 1 of line 241
+	return getCycleAtDot(0, 241) + 1;
+}
+
+uint64_t NESPPU::getStatusChangeCycle() const
+{
+	return statusChangeCycle;
+}
+
+uint64_t NESPPU::getNextStatusChangeCycle() const
+{
+	// The first tick() that might change what a $2002 read returns
+	uint64_t result = getCycleAtDot(0, 241);
+	if (ppuStatus & (PPUSTATUS_SPRITE_ZERO_HIT | PPUSTATUS_VBLANK | PPUSTATUS_SPRITE_OVERFLOW)) {
+		result = std::min(result, getCycleAtDot(1, 261));
+	}
+
+	// Sprite overflow is flagged on dot 256 of a visible line with more than 8 sprites on it. If OAM changed since the
+	// sprite index was built, any line could be one.
+	if ((ppuMask & (PPUMASK_SHOW_BACKGROUND | PPUMASK_SHOW_SPRITES)) && !(ppuStatus & PPUSTATUS_SPRITE_OVERFLOW)) {
+		const uint32_t firstLine = curY < 240 && curX <= 256 ? curY : (curY < 239 ? curY + 1 : 0);
+		const bool known = spriteIndex.isUpToDate(getSpriteHeight());
+		for (uint32_t y = firstLine; y < 240; ++y) {
+			if (!known || spriteIndex.hasOverflow(uint8_t(y))) {
+				result = std::min(result, getCycleAtDot(256, y));
+				break;
+			}
+		}
+	}
+
+	// Sprite zero hits need both layers on, and only happen on the dots that output pixels
+	const bool bothLayers = (ppuMask & PPUMASK_SHOW_BACKGROUND) && (ppuMask & PPUMASK_SHOW_SPRITES);
+	if (bothLayers && !(ppuStatus & PPUSTATUS_SPRITE_ZERO_HIT)) {
+		if (curY < 240 && curX <= 256) {
+			result = std::min(result, getCycleAtDot(std::max(curX, 1u), curY));
 		} else {
-			value = static_cast<NESPPU*>(self)->readRegister(realAddress);
+			result = std::min(result, getCycleAtDot(1, curY < 239 ? curY + 1 : 0));
 		}
-	});
+	}
+
+	return result;
+}
+
+uint64_t NESPPU::getScanlineClockCycle(uint32_t n) const
+{
+	// The tick() that makes the nth scanline callback from now, assuming rendering stays as it is
+	if (n == 0 || !(ppuMask & (PPUMASK_SHOW_BACKGROUND | PPUMASK_SHOW_SPRITES))) {
+		return std::numeric_limits<uint64_t>::max();
+	}
+
+	uint64_t result = cycle;
+	uint32_t x = curX;
+	uint32_t y = curY;
+	uint32_t frame = frameN;
+	while (true) {
+		const bool isPreRenderLine = y == 261;
+		if ((y < 240 || isPreRenderLine) && x <= 260 && --n == 0) {
+			return result + (260 - x);
+		}
+		const uint32_t scanLen = isPreRenderLine && frame % 2 == 1 ? 340 : 341;
+		result += scanLen - x;
+		x = 0;
+		if (++y == 262) {
+			++frame;
+			y = 0;
+		}
+	}
+}
+
+uint64_t NESPPU::getCycleAtDot(uint32_t targetX, uint32_t targetY) const
+{
+	// The cycle count when tick() is next about to process the given dot (now, if it's the current one)
+	uint64_t result = cycle;
+	uint32_t x = curX;
+	uint32_t y = curY;
+	uint32_t frame = frameN;
+	while (y != targetY || x > targetX) {
+		const bool isPreRenderLine = y == 261;
+		const uint32_t scanLen = isPreRenderLine && frame % 2 == 1 ? 340 : 341;
+		result += scanLen - x;
+		x = 0;
+		if (++y == 262) {
+			++frame;
+			y = 0;
+		}
+	}
+	return result + (targetX - x);
 }
 
 uint8_t NESPPU::readRegister(uint16_t address)
@@ -199,7 +329,10 @@ uint8_t NESPPU::readRegister(uint16_t address)
 	case 0x2002:
 		{
 			const uint8_t value = ppuStatus;
-			ppuStatus &= ~PPUSTATUS_VBLANK;
+			if (ppuStatus & PPUSTATUS_VBLANK) {
+				ppuStatus &= ~PPUSTATUS_VBLANK;
+				statusChangeCycle = cycle;
+			}
 			wRegister = false;
 			return value;
 		}
@@ -249,6 +382,7 @@ void NESPPU::writeRegister(uint16_t address, uint8_t value)
 	case 0x2004:
 		if (!isRendering()) {
 			oamData[oamAddr++] = value;
+			spriteIndex.invalidate();
 		}
 		break;
 	case 0x2005:
@@ -294,14 +428,177 @@ void NESPPU::setFrameBuffer(gsl::span<uint32_t> fb)
 
 gsl::span<uint8_t> NESPPU::getOAMData()
 {
+	spriteIndex.invalidate();
 	return oamData;
 }
 
+bool NESPPU::isTileDirty(uint16_t tile) const
+{
+	return dirtyTiles[tile];
+}
+
+const NESPPU::TileSet& NESPPU::getDirtyTiles() const
+{
+	return dirtyTiles;
+}
+
+NESPPU::TileSet NESPPU::takeDirtyTiles()
+{
+	auto result = dirtyTiles;
+	dirtyTiles.reset();
+	return result;
+}
+
 uint32_t NESPPU::getFrameNumber() const
 {
 	return frameN;
 }
 
+void NESPPU::renderScanline()
+{
+	// Does what 341 calls to tick() would on a visible line, phase by phase instead of dot by dot
+	const uint64_t lineStartCycle = cycle;
+	const bool rendering = isRendering();
+	tileCache.update(*addressSpace, takeDirtyTiles());
+
+	// Dots 1-256: pixels, background fetches and the horizontal/vertical increments
+	std::array<uint8_t, 256> background;
+	renderBackgroundLine(background);
+
+	const uint8_t spriteMask = ppuMask & (PPUMASK_SHOW_SPRITES | PPUMASK_SHOW_SPRITES_LEFT);
+	if (!spriteLineValid || spriteLineMask != spriteMask) {
+		renderSpriteLine(spriteLine);
+		spriteLineValid = true;
+		spriteLineMask = spriteMask;
+	}
+
+	std::array<uint8_t, 256> indices;
+	const int hit = NESLineMixer::mix(background, spriteLine, indices);
+	if (hit >= 0 && !(ppuStatus & PPUSTATUS_SPRITE_ZERO_HIT)) {
+		ppuStatus |= PPUSTATUS_SPRITE_ZERO_HIT;
+		statusChangeCycle = lineStartCycle + uint64_t(hit) + 1;
+	}
+
+	uint32_t* dst = frameBuffer.data() + size_t(curY) * 256;
+	for (size_t x = 0; x < 256; ++x) {
+		dst[x] = paletteToColour(paletteRAM[paletteIndices[indices[x]]]);
+	}
+
+	if (rendering) {
+		// Dots 1-256: secondary OAM is cleared, then filled. Overflow is flagged on dot 256.
+		std::fill(oamSecondaryData.begin(), oamSecondaryData.end(), uint8_t(0xFF));
+		cycle = lineStartCycle + 256;
+		curX = 256;
+		evaluateSprites();
+
+		// Dot 257
+		RegisterCoarseX::of(vRegister).set(RegisterCoarseX::of(tRegister));
+		RegisterNametableSelectX::of(vRegister).set(RegisterNametableSelectX::of(tRegister));
+	}
+	oamAddr = 0;
+
+	if (rendering) {
+		// Dot 260. The callback can look at where the PPU is (e.g. to schedule the next IRQ), so it has to be there.
+		if (scanlineCallback) {
+			cycle = lineStartCycle + 260;
+			curX = 260;
+			scanlineCallback(scanlineCallbackData);
+		}
+
+		// Dot 320
+		curX = 320;
+		fetchSprites();
+
+		// Dots 321-336: the first two tiles of the next line. Short enough to just tick through.
+		for (curX = 321; curX <= 336; ++curX) {
+			tickBackgroundFetch();
+			if (curX % 8 == 0) {
+				incrementHorizontalPos();
+			}
+		}
+	}
+
+	cycle = lineStartCycle + 341;
+	curX = 0;
+	++curY;
+}
+
+void NESPPU::renderBackgroundLine(std::array<uint8_t, 256>& pixels)
+{
+	// Fills in pixel values in bits 0-1 and palettes in bits 2-3
+	pixels.fill(0);
+	if (!isRendering()) {
+		return;
+	}
+
+	// The line's 34 tiles, which fine x scroll then picks 256 pixels out of. Tile 0 is still in the top of the shift
+	// registers and tile 1 is in the latches, both fetched at the end of the previous line. The other 32 are fetched on
+	// this one.
+	NESBackgroundLine::Tiles tiles;
+	NESBackgroundLine::Palettes palettes;
+
+	// Tile 0 is read out of the shift registers, whose palette bits needn't all agree (e.g. when rendering was only
+	// switched on partway through the previous line)
+	NESTileCache::Row shifted;
+	for (size_t i = 0; i < 8; ++i) {
+		const uint8_t value = uint8_t(((patternTableHighShiftRegister >> (15 - i)) & 1) << 1 | ((patternTableLowShiftRegister >> (15 - i)) & 1));
+		const uint8_t palette = uint8_t(((attributeHighShiftRegister >> i) & 1) << 1 | ((attributeLowShiftRegister >> i) & 1));
+		shifted[i] = uint8_t(value | (palette << 2));
+	}
+	tiles[0] = &shifted;
+	palettes[0] = 0;
+
+	const auto latched = NESTileCache::decodeRow(patternTableLowLatch, patternTableHighLatch, false);
+	tiles[1] = &latched;
+	palettes[1] = attributeLatch;
+
+	const uint16_t patternTable = (ppuCtrl & PPUCTRL_BACKGROUND_PATTERN_TABLE_ADDRESS) ? 0x1000 : 0x0000;
+	for (size_t i = 2; i < NESBackgroundLine::numTiles; ++i) {
+		const uint8_t tile = fetchByte(RegisterTileAddress(vRegister).getValue() | 0x2000);
+		const uint16_t attributeAddr = 0x23C0 | (vRegister & 0x0C00) | ((vRegister >> 4) & 0x38) | ((vRegister >> 2) & 0x07);
+		const uint8_t paletteOffset = (RegisterCoarseX(vRegister).getValue() & 0x2) | ((RegisterCoarseY(vRegister).getValue() & 0x2) << 1);
+		palettes[i] = (fetchByte(attributeAddr) >> paletteOffset) & 0x3;
+		tiles[i] = &tileCache.getRow(patternTable | tile * 16 | RegisterFineY(vRegister).getValue());
+		incrementHorizontalPos();
+	}
+	incrementVerticalPos();
+
+	if (!(ppuMask & PPUMASK_SHOW_BACKGROUND)) {
+		return;
+	}
+
+	const size_t start = (ppuMask & PPUMASK_SHOW_BACKGROUND_LEFT) ? 0 : 8;
+	NESBackgroundLine::compose(tiles, palettes, xRegister, start, pixels);
+}
+
+void NESPPU::renderSpriteLine(std::array<uint8_t, 256>& pixels) const
+{
+	// In the format NESLineMixer takes
+	pixels.fill(0);
+	if (!(ppuMask & PPUMASK_SHOW_SPRITES)) {
+		return;
+	}
+
+	// The x counters only count down on dots where sprites are shown. Going backwards lets lower slots win.
+	const size_t start = (ppuMask & PPUMASK_SHOW_SPRITES_LEFT) ? 0 : 8;
+	for (size_t i = 8; i-- > 0;) {
+		const auto& sprite = spriteData[i];
+		const uint8_t flags = uint8_t(((sprite.attributes & 0x3) << 2)
+			| ((sprite.attributes & 0x20) ? NESLineMixer::spriteBehindBackground : 0)
+			| (i == 0 ? NESLineMixer::spriteZero : 0));
+		for (size_t pixel = sprite.pixelsShown; pixel < 8; ++pixel) {
+			const size_t x = start + sprite.x + pixel - sprite.pixelsShown;
+			if (x >= 256) {
+				break;
+			}
+			const uint8_t value = sprite.pixels[pixel];
+			if (value != 0) {
+				pixels[x] = uint8_t(value | flags);
+			}
+		}
+	}
+}
+
 void NESPPU::generatePixel(uint8_t x, uint8_t y)
 {
 	auto bg = generateBackground(x, y);
@@ -310,8 +607,9 @@ void NESPPU::generatePixel(uint8_t x, uint8_t y)
 	PixelOutput result;
 	if (sprite.value != 0 && bg.value != 0) {
 		result = sprite.priority == 0 ? sprite : bg;
-		if (sprite.spriteN == 0) {
+		if (sprite.spriteN == 0 && !(ppuStatus & PPUSTATUS_SPRITE_ZERO_HIT)) {
 			ppuStatus |= PPUSTATUS_SPRITE_ZERO_HIT;
+			statusChangeCycle = cycle;
 		}
 	} else if (sprite.value != 0) {
 		result = sprite;
@@ -321,7 +619,7 @@ void NESPPU::generatePixel(uint8_t x, uint8_t y)
 		result = { bg.value, 0, 0, 0 };
 	}
 	
-	const uint8_t colour = addressSpace->readDirect(0x3F00 + 4 * result.palette + result.value);
+	const uint8_t colour = paletteRAM[paletteIndices[4 * result.palette + result.value]];
 
 	frameBuffer[size_t(x) + size_t(y) * 256] = paletteToColour(colour);
 }
@@ -353,16 +651,17 @@ NESPPU::PixelOutput NESPPU::generateSprite(uint8_t x, uint8_t y)
 		return PixelOutput { 0, 0, 0, 0 };
 	}
 	
+	// This moves the sprites along, which spriteLine doesn't know about
+	spriteLineValid = false;
+
 	auto result = PixelOutput { 0, 0, 0, 0 };
 	for (size_t i = 0; i < 8; ++i) {
 		if (spriteData[i].x > 0) {
 			--spriteData[i].x;
-		} else {
-			const uint8_t value = (spriteData[i].patternTable0 & 0x1) | ((spriteData[i].patternTable1 & 0x1) << 1);
+		} else if (spriteData[i].pixelsShown < 8) {
+			const uint8_t value = spriteData[i].pixels[spriteData[i].pixelsShown++];
 			const uint8_t palette = spriteData[i].attributes & 0x3;
 			const uint8_t priority = (spriteData[i].attributes >> 5) & 0x1;
-			spriteData[i].patternTable0 >>= 1;
-			spriteData[i].patternTable1 >>= 1;
 			if (value != 0 && result.value == 0) {
 				result.value = value;
 				result.palette = uint8_t(palette + 4);
@@ -448,8 +747,6 @@ uint32_t NESPPU::paletteToColour(uint8_t palette)
 
 void NESPPU::tickSpriteFetch()
 {
-	const bool tallSprites = (ppuCtrl & PPUCTRL_SPRITE_SIZE) != 0;
-
 	if (curX == 0) {
 		// Do nothing
 	} else if (curX <= 64) {
@@ -464,53 +761,91 @@ void NESPPU::tickSpriteFetch()
 		// Should happen spread between 65 and 256, but doing it all in one go here
 		// TIMING ISSUE: if the oamData changes between 65 and 255, the emulation might be incorrect
 		if (curX == 256) {
-			size_t spriteDst = 0;
-			const uint8_t scanline = curY;
-			
-			for (size_t spriteSrc = 0; spriteSrc < 256; spriteSrc += 4) {
-				const uint8_t spriteY = oamData[spriteSrc];
-				const uint8_t spriteHeight = 8;
-				if (scanline >= uint8_t(spriteY) && scanline < static_cast<uint8_t>(spriteY + spriteHeight)) {
-					// In range
-					oamSecondaryData[spriteDst] = spriteY;
-					oamSecondaryData[spriteDst + 1] = oamData[spriteSrc + 1];
-					oamSecondaryData[spriteDst + 2] = oamData[spriteSrc + 2];
-					oamSecondaryData[spriteDst + 3] = oamData[spriteSrc + 3];
-					spriteDst += 4;
-
-					if (spriteDst == 32) {
-						break;
-					}
-				}
-			}
+			evaluateSprites();
 		}
 	} else {
 		// Sprite fetching (257-320)
 		// Should happen between 257-320
 		// TIMING ISSUE: if the pattern table changes between 257-319, the emulation might be incorrect
 		if (curX == 320) {
-			for (size_t i = 0; i < 8; ++i) {
-				const uint8_t y = oamSecondaryData[i * 4];
-				const uint8_t index = oamSecondaryData[i * 4 + 1] >> (tallSprites ? 1 : 0);
-				auto& sprite = spriteData[i];
-				sprite.attributes = oamSecondaryData[i * 4 + 2];
-				sprite.x = oamSecondaryData[i * 4 + 3];
-
-				const bool flipHorizontal = (sprite.attributes & 0x40) == 0;
-				const bool flipVertical = (sprite.attributes & 0x80) != 0;
-
-				const uint8_t pixelYinTile = flipVertical ? (7 - curY + y) : curY - y;
-				const uint16_t patternTable = tallSprites ? (index & 0x1) : (ppuCtrl & PPUCTRL_SPRITE_PATTERN_TABLE_ADDRESS) ? 0x1000 : 0x0000;
-				
-				sprite.patternTable0 = addressSpace->readDirect(patternTable + (index * 16) + pixelYinTile);
-				sprite.patternTable1 = addressSpace->readDirect(patternTable + (index * 16) + pixelYinTile + 8);
-				if (flipHorizontal) {
-					sprite.patternTable0 = reverseBits(sprite.patternTable0);
-					sprite.patternTable1 = reverseBits(sprite.patternTable1);
-				}
-			}
+			fetchSprites();
+		}
+	}
+}
+
+void NESPPU::evaluateSprites()
+{
+	const uint8_t scanline = uint8_t(curY);
+	spriteIndex.update(oamData, getSpriteHeight());
+
+	// The first 8 in OAM order go into secondary OAM
+	size_t spriteDst = 0;
+	uint64_t sprites = spriteIndex.getSprites(scanline);
+	for (size_t spriteSrc = 0; sprites != 0 && spriteDst < 32; spriteSrc += 4, sprites >>= 1) {
+		if (sprites & 1) {
+			oamSecondaryData[spriteDst] = oamData[spriteSrc];
+			oamSecondaryData[spriteDst + 1] = oamData[spriteSrc + 1];
+			oamSecondaryData[spriteDst + 2] = oamData[spriteSrc + 2];
+			oamSecondaryData[spriteDst + 3] = oamData[spriteSrc + 3];
+			spriteDst += 4;
+		}
+	}
+
+	// Without the hardware's buggy way of finding a 9th sprite, which can both miss some and see some that aren't there
+	if (curY < 240 && spriteIndex.hasOverflow(scanline) && !(ppuStatus & PPUSTATUS_SPRITE_OVERFLOW)) {
+		ppuStatus |= PPUSTATUS_SPRITE_OVERFLOW;
+		statusChangeCycle = cycle;
+	}
+}
+
+uint8_t NESPPU::getSpriteHeight() const
+{
+	return (ppuCtrl & PPUCTRL_SPRITE_SIZE) ? 16 : 8;
+}
+
+void NESPPU::fetchSprites()
+{
+	const bool tallSprites = (ppuCtrl & PPUCTRL_SPRITE_SIZE) != 0;
+	if (!busInstrumented) {
+		tileCache.update(*addressSpace, takeDirtyTiles());
+	}
+
+	for (size_t i = 0; i < 8; ++i) {
+		const uint8_t y = oamSecondaryData[i * 4];
+		const uint8_t index = oamSecondaryData[i * 4 + 1];
+		auto& sprite = spriteData[i];
+		sprite.attributes = oamSecondaryData[i * 4 + 2];
+		sprite.x = oamSecondaryData[i * 4 + 3];
+
+		sprite.pixelsShown = 0;
+
+		const bool flipHorizontal = (sprite.attributes & 0x40) != 0;
+		const bool flipVertical = (sprite.attributes & 0x80) != 0;
+
+		uint16_t addr;
+		if (tallSprites) {
+			// 8x16 sprites pick their pattern table with bit 0 of the index, and are two tiles one above the other
+			const uint8_t pixelYinSprite = (flipVertical ? (15 - curY + y) : curY - y) & 0xF;
+			const uint16_t patternTable = (index & 0x1) ? 0x1000 : 0x0000;
+			const uint8_t tile = (index & 0xFE) | (pixelYinSprite >> 3);
+			addr = uint16_t(patternTable + (tile * 16) + (pixelYinSprite & 0x7));
+		} else {
+			const uint8_t pixelYinTile = flipVertical ? (7 - curY + y) : curY - y;
+			const uint16_t patternTable = (ppuCtrl & PPUCTRL_SPRITE_PATTERN_TABLE_ADDRESS) ? 0x1000 : 0x0000;
+			addr = uint16_t(patternTable + (index * 16) + pixelYinTile);
+		}
+		
+		if (addr < 0x2000 && (addr & 0x8) == 0 && !busInstrumented) {
+			sprite.pixels = flipHorizontal ? tileCache.getFlippedRow(addr) : tileCache.getRow(addr);
+		} else {
+			// Rows that straddle two tiles (only empty slots fetch those) or that whoever's watching the bus should see
+			sprite.pixels = NESTileCache::decodeRow(fetchByte(addr), fetchByte(addr + 8), flipHorizontal);
 		}
 	}
+
+	renderSpriteLine(spriteLine);
+	spriteLineValid = true;
+	spriteLineMask = ppuMask & (PPUMASK_SHOW_SPRITES | PPUMASK_SHOW_SPRITES_LEFT);
 }
 
 void NESPPU::tickBackgroundFetch()
@@ -518,24 +853,26 @@ void NESPPU::tickBackgroundFetch()
 	// Background fetching
 	if ((curX >= 1 && curX < 257) || (curX >= 321 && curX <= 336)) {
 		if (curX % 8 == 1) {
-			nameTableLatch = readByte(RegisterTileAddress(vRegister).getValue() | 0x2000);
+			nameTableLatch = fetchByte(RegisterTileAddress(vRegister).getValue() | 0x2000);
 		} else if (curX % 8 == 3) {
 			const uint16_t addr = 0x23C0 | (vRegister & 0x0C00) | ((vRegister >> 4) & 0x38) | ((vRegister >> 2) & 0x07);
-			const uint8_t value = readByte(addr);
+			const uint8_t value = fetchByte(addr);
 			const uint8_t paletteOffset = (RegisterCoarseX(vRegister).getValue() & 0x2) | ((RegisterCoarseY(vRegister).getValue() & 0x2) << 1);
 			attributeLatch = (value >> paletteOffset) & 0x3;
 		} else {
 			const uint16_t patternTable = (ppuCtrl & PPUCTRL_BACKGROUND_PATTERN_TABLE_ADDRESS) ? 0x1000 : 0x0000;
 			const uint16_t addr = patternTable | nameTableLatch * 16 | RegisterFineY(vRegister).getValue();
 			if (curX % 8 == 5) {
-				patternTableLowLatch = readByte(addr);
+				patternTableLowLatch = fetchByte(addr);
 			} else if (curX % 8 == 7) {
-				patternTableHighLatch = readByte(addr + 8);
+				patternTableHighLatch = fetchByte(addr + 8);
 			}
 		}
 	} else if (curX >= 337 && curX % 2 == 1) {
-		// Redundant nametable read
-		readByte(RegisterTileAddress(vRegister).getValue() | 0x2000);
+		// Redundant nametable read, which only matters to whoever's watching
+		if (busInstrumented) {
+			fetchByte(RegisterTileAddress(vRegister).getValue() | 0x2000);
+		}
 	}
 
 	// Shift registers
@@ -561,40 +898,42 @@ void NESPPU::tickBackgroundFetch()
 
 void NESPPU::writeByte(uint16_t address, uint8_t value)
 {
-	// This is to address the insane palette mirroring
-	// 0x3F10 -> 0x3F00
-	// 0x3F14 -> 0x3F04
-	// 0x3F18 -> 0x3F08
-	// 0x3F1C -> 0x3F0C
-	// ONLY those four addresses map in this way
-	if (address >= 0x3F10 && address <= 0x3F1C && (address & 0x3) == 0) {
-		address -= 0x10;
+	if (address >= 0x3F00) {
+		paletteRAM[paletteIndices[address & 0x1F]] = value;
+		return;
+	}
+	if (address < 0x2000) {
+		// The tile cache works out where dirty tiles live from where their pages pointed when it last caught up, so
+		// after a bank switch it has to catch up before anything else gets written. On CHR-ROM this write goes
+		// nowhere, but a spurious dirty tile costs nothing.
+		const uint8_t page = uint8_t(address >> 8);
+		if (!tileCache.isPageCurrent(page, addressSpace->getPage(page))) {
+			tileCache.update(*addressSpace, takeDirtyTiles());
+		}
+		dirtyTiles[address >> 4] = true;
 	}
 	addressSpace->write(address, value);
 }
 
 uint8_t NESPPU::readByte(uint16_t address)
 {
-	// See note above
-	if (address >= 0x3F10 && address <= 0x3F1C && (address & 0x3) == 0) {
-		address -= 0x10;
+	if (address >= 0x3F00) {
+		return paletteRAM[paletteIndices[address & 0x1F]];
 	}
 	return addressSpace->read(address);
 }
 
-bool NESPPU::isRendering() const
+uint8_t NESPPU::fetchByte(uint16_t address) const
 {
-	return (curY < 240 || curY == 261) && (ppuMask & PPUMASK_SHOW_BACKGROUND || ppuMask & PPUMASK_SHOW_SPRITES);
+	// Rendering only ever fetches from pattern tables and nametables, which are always mapped as whole pages, so this
+	// goes straight to the CHR bank and nametable the page points at
+	if (busInstrumented) {
+		return addressSpace->read(address);
+	}
+	return addressSpace->getPage(uint8_t(address >> 8))[address & 0xFF];
 }
 
-uint8_t NESPPU::reverseBits(uint8_t bits) const
+bool NESPPU::isRendering() const
 {
-	return ((bits & 0x01) << 7)
-		| ((bits & 0x02) << 5)
-		| ((bits & 0x04) << 3)
-		| ((bits & 0x08) << 1)
-		| ((bits & 0x10) >> 1)
-		| ((bits & 0x20) >> 3)
-		| ((bits & 0x40) >> 5)
-		| ((bits & 0x80) >> 7);
+	return (curY < 240 || curY == 261) && (ppuMask & PPUMASK_SHOW_BACKGROUND || ppuMask & PPUMASK_SHOW_SPRITES);
 }
@@ -1,40 +1,72 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <vector>
 #include <gsl/gsl>
 #include "../utils/macros.h"
+#include "nes_sprite_index.h"
+#include "nes_tile_cache.h"
 
 class AddressSpace8BitBy16Bit;
 
 class NESPPU {
 public:
+	// The 512 16-byte tiles of pattern space, $0000-$1FFF, by PPU address
+	constexpr static size_t numTiles = 512;
+	using TileSet = NESTileCache::TileSet;
+
 	NESPPU();
 	
     bool tick();
+	bool runUntil(uint64_t targetCycle);
 	
     uint64_t getCycle() const;
+	uint64_t getNextVBlankCycle() const;
+	uint64_t getStatusChangeCycle() const;
+	uint64_t getNextStatusChangeCycle() const;
+	uint64_t getScanlineClockCycle(uint32_t n) const;
 	uint32_t getFrameNumber() const;
 	uint32_t getX() const;
 	uint32_t getY() const;
 	bool canGenerateNMI() const;
 
+	// Register state, without the side effects of reading it through readRegister, e.g. for checking one renderer
+	// against another
+	uint8_t getStatus() const;
+	uint16_t getVRAMAddress() const;
+	uint8_t getOAMAddress() const;
+
 	void setAddressSpace(AddressSpace8BitBy16Bit& addressSpace);
-	void mapRegistersOnCPUAddressSpace(AddressSpace8BitBy16Bit& addressSpace);
+
+	// Called on dot 260 of every rendered scanline, which is where MMC3 sees its scanline counter clock
+	void setScanlineCallback(void* data, void(*callback)(void*));
 
 	uint8_t readRegister(uint16_t address);
 	void writeRegister(uint16_t address, uint8_t value);
 
 	void setFrameBuffer(gsl::span<uint32_t> frameBuffer);
+
+	// For writing OAM, e.g. by DMA. Assumes it does get written, so sprites on each line are worked out again.
 	gsl::span<uint8_t> getOAMData();
 
+	// Tiles written through $2007 (i.e. CHR-RAM) that the tile cache hasn't caught up with yet. It takes them, and
+	// redoes just those, before every line it draws from. Bank switches don't mark anything: they change which memory
+	// a page points at, not its contents. Everything starts out dirty.
+	bool isTileDirty(uint16_t tile) const;
+	const TileSet& getDirtyTiles() const;
+
 private:
 	uint64_t cycle = 0;
 	uint32_t curX = 0;
 	uint32_t curY = 0;
 	uint32_t frameN = 0;
+	uint64_t statusChangeCycle = 0;
 
 	AddressSpace8BitBy16Bit* addressSpace = nullptr;
+	bool busInstrumented = false; // Breakpoints or profiling on the PPU bus, which rendering fetches mustn't skip
+	void* scanlineCallbackData = nullptr;
+	void(*scanlineCallback)(void*) = nullptr;
 
 	// PPU flags
 	uint8_t ppuStatus = 0;
@@ -62,17 +94,36 @@ private:
 
 	uint8_t oamAddr = 0;
 
+	TileSet dirtyTiles;
+	NESTileCache tileCache;
+
+	TileSet takeDirtyTiles();
+
+	// Palette RAM isn't on the bus. $3F10/$3F14/$3F18/$3F1C are the same entries as $3F00/$3F04/$3F08/$3F0C.
+	constexpr static std::array<uint8_t, 32> paletteIndices = {
+		0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+		0x00, 0x11, 0x12, 0x13, 0x04, 0x15, 0x16, 0x17, 0x08, 0x19, 0x1A, 0x1B, 0x0C, 0x1D, 0x1E, 0x1F
+	};
+	std::array<uint8_t, 32> paletteRAM = {};
+
 	gsl::span<uint32_t> frameBuffer;
 	std::vector<uint8_t> oamData;
 	std::vector<uint8_t> oamSecondaryData;
+	NESSpriteIndex spriteIndex;
 
 	struct SpriteData {
-		uint8_t patternTable0;
-		uint8_t patternTable1;
+		NESTileCache::Row pixels; // In the order they're output, so already flipped
+		uint8_t pixelsShown;
 		uint8_t attributes;
 		uint8_t x;
 	} spriteData[8];
 
+	// spriteData drawn out as soon as it's fetched, for the scanline renderer. Only good while it matches spriteData
+	// (which the dot renderer changes as it goes) and the sprite bits of ppuMask.
+	std::array<uint8_t, 256> spriteLine;
+	bool spriteLineValid = false;
+	uint8_t spriteLineMask = 0;
+
 	struct PixelOutput {
 		uint8_t value;
 		uint8_t palette;
@@ -80,6 +131,12 @@ private:
 		uint8_t spriteN;
 	};
 
+	uint64_t getCycleAtDot(uint32_t x, uint32_t y) const;
+
+	void renderScanline();
+	void renderBackgroundLine(std::array<uint8_t, 256>& pixels);
+	void renderSpriteLine(std::array<uint8_t, 256>& pixels) const;
+
 	void generatePixel(uint8_t x, uint8_t y);
 	PixelOutput generateBackground(uint8_t x, uint8_t y);
 	PixelOutput generateSprite(uint8_t x, uint8_t y);
@@ -90,10 +147,13 @@ private:
 
 	void tickSpriteFetch();
 	void tickBackgroundFetch();
+	void evaluateSprites();
+	void fetchSprites();
 
 	void writeByte(uint16_t address, uint8_t value);
 	uint8_t readByte(uint16_t address);
+	FORCEINLINE uint8_t fetchByte(uint16_t address) const;
 	
 	FORCEINLINE bool isRendering() const;
-	FORCEINLINE uint8_t reverseBits(uint8_t bits) const;
+	uint8_t getSpriteHeight() const;
 };
@@ -22,10 +22,10 @@ bool NESRom::load(gsl::span<const std::byte> romData)
 
 	// Flags 6
 	const uint8_t flags6 = dataLeft[6];
-	mirroring = (flags6 & 0x01) ? MirroringType::Vertical : MirroringType::Horizontal;
 	hasBatteryRAM = (flags6 & 0x02) != 0;
 	const bool hasTrainer = (flags6 & 0x04) != 0;
 	const bool ignoreMirroringControl = (flags6 & 0x08) != 0;
+	mirroring = ignoreMirroringControl ? NESMirroring::FourScreen : (flags6 & 0x01) ? NESMirroring::Vertical : NESMirroring::Horizontal;
 	mapper = flags6 >> 4;
 
 	// Flags 7
@@ -92,3 +92,8 @@ uint16_t NESRom::getMapper() const
 {
 	return mapper;
 }
+
+NESMirroring NESRom::getMirroring() const
+{
+	return mirroring;
+}
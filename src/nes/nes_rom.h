@@ -3,20 +3,24 @@
 #include <gsl/gsl>
 #include <cstddef>
 
+enum class NESMirroring : uint8_t {
+	Horizontal,
+	Vertical,
+	SingleScreenLower,
+	SingleScreenUpper,
+	FourScreen // Extra VRAM on the cartridge, so every nametable is separate
+};
+
 class NESRom {
 public:
 	bool load(gsl::span<const std::byte> romData);
 	gsl::span<uint8_t> getPRGROM();
 	gsl::span<uint8_t> getCHRROM();
 	uint16_t getMapper() const;
+	NESMirroring getMirroring() const;
 
 private:
-	enum class MirroringType : uint8_t {
-		Horizontal,
-		Vertical
-	};
-
-	MirroringType mirroring = MirroringType::Horizontal;
+	NESMirroring mirroring = NESMirroring::Horizontal;
 	bool hasBatteryRAM = false;
 	uint16_t mapper = 0;
 
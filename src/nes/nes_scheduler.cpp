@@ -0,0 +1,52 @@
+#include "nes_scheduler.h"
+
+#include <algorithm>
+
+NESScheduler::NESScheduler()
+{
+	eventCycles.fill(never);
+}
+
+void NESScheduler::schedule(NESEvent event, uint64_t cycle)
+{
+	eventCycles[static_cast<size_t>(event)] = cycle;
+	updateNextEventCycle();
+}
+
+void NESScheduler::cancel(NESEvent event)
+{
+	schedule(event, never);
+}
+
+uint64_t NESScheduler::getNextEventCycle() const
+{
+	return nextEventCycle;
+}
+
+bool NESScheduler::popDueEvent(uint64_t cycle, NESEvent& event)
+{
+	if (nextEventCycle > cycle) {
+		return false;
+	}
+
+	// There's only a handful of events, so a linear scan beats keeping a heap in order
+	size_t best = 0;
+	for (size_t i = 1; i < numEvents; ++i) {
+		if (eventCycles[i] < eventCycles[best]) {
+			best = i;
+		}
+	}
+
+	event = static_cast<NESEvent>(best);
+	eventCycles[best] = never;
+	updateNextEventCycle();
+	return true;
+}
+
+void NESScheduler::updateNextEventCycle()
+{
+	nextEventCycle = never;
+	for (const auto cycle: eventCycles) {
+		nextEventCycle = std::min(nextEventCycle, cycle);
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+enum class NESEvent : uint8_t {
+	VBlank, // PPU flags vblank, raises NMI and ends the frame
+	MapperIRQ, // Cartridge asserts (or might have asserted) its IRQ line
+	DMCFetch, // The APU's DMC needs a sample byte, which DMA takes off the CPU bus
+
+	NumEvents
+};
+
+// Timestamped events on the CPU clock. Each event is pending at most once; scheduling it again moves it.
+class NESScheduler {
+public:
+	constexpr static uint64_t never = UINT64_MAX;
+
+	NESScheduler();
+
+	void schedule(NESEvent event, uint64_t cycle);
+	void cancel(NESEvent event);
+
+	// The CPU can run uninterrupted until this cycle
+	uint64_t getNextEventCycle() const;
+
+	// Takes the earliest event due at or before cycle, returns false if there's none
+	bool popDueEvent(uint64_t cycle, NESEvent& event);
+
+private:
+	constexpr static size_t numEvents = static_cast<size_t>(NESEvent::NumEvents);
+
+	std::array<uint64_t, numEvents> eventCycles;
+	uint64_t nextEventCycle = never;
+
+	void updateNextEventCycle();
+};
@@ -0,0 +1,87 @@
+#include "nes_sprite_index.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define EMUND_SPRITE_INDEX_SSE2
+#endif
+
+void NESSpriteIndex::invalidate()
+{
+	builtHeight = 0;
+}
+
+bool NESSpriteIndex::isUpToDate(uint8_t height) const
+{
+	return builtHeight == height;
+}
+
+void NESSpriteIndex::update(gsl::span<const uint8_t> oam, uint8_t height)
+{
+	if (builtHeight != height) {
+		build(oam, height);
+		for (size_t i = 0; i < 256; ++i) {
+			overflow[i] = std::bitset<64>(sprites[i]).count() > 8;
+		}
+		builtHeight = height;
+	}
+}
+
+uint64_t NESSpriteIndex::getSprites(uint8_t scanline) const
+{
+	return sprites[scanline];
+}
+
+bool NESSpriteIndex::hasOverflow(uint8_t scanline) const
+{
+	return overflow[scanline];
+}
+
+void NESSpriteIndex::build(gsl::span<const uint8_t> oam, uint8_t height)
+{
+	Expects(oam.size() >= 256);
+
+	// A sprite is on a scanline when (uint8_t)(scanline - y) < height. One whose bottom would wrap past 255 is on none.
+#if defined(EMUND_SPRITE_INDEX_SSE2)
+	// Gather the 64 Y coordinates, the first byte of each sprite, into 4 vectors of 16
+	const __m128i lowByte = _mm_set1_epi32(0xFF);
+	__m128i ys[4];
+	__m128i visible[4];
+	const __m128i maxY = _mm_set1_epi8(char(255 - height));
+	for (size_t i = 0; i < 4; ++i) {
+		const uint8_t* src = oam.data() + i * 64;
+		const __m128i a = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), lowByte);
+		const __m128i b = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16)), lowByte);
+		const __m128i c = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32)), lowByte);
+		const __m128i d = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48)), lowByte);
+		ys[i] = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+		visible[i] = _mm_cmpeq_epi8(_mm_min_epu8(ys[i], maxY), ys[i]);
+	}
+
+	const __m128i lastRow = _mm_set1_epi8(char(height - 1));
+	for (size_t scanline = 0; scanline < 256; ++scanline) {
+		const __m128i line = _mm_set1_epi8(char(scanline));
+		uint64_t result = 0;
+		for (size_t i = 0; i < 4; ++i) {
+			const __m128i row = _mm_sub_epi8(line, ys[i]);
+			const __m128i inRange = _mm_and_si128(_mm_cmpeq_epi8(_mm_min_epu8(row, lastRow), row), visible[i]);
+			result |= uint64_t(uint16_t(_mm_movemask_epi8(inRange))) << (i * 16);
+		}
+		sprites[scanline] = result;
+	}
+#else
+	buildScalar(oam, height);
+#endif
+}
+
+void NESSpriteIndex::buildScalar(gsl::span<const uint8_t> oam, uint8_t height)
+{
+	sprites.fill(0);
+	for (size_t i = 0; i < 64; ++i) {
+		const size_t y = oam[i * 4];
+		if (y + height <= 255) {
+			for (size_t row = 0; row < height; ++row) {
+				sprites[y + row] |= uint64_t(1) << i;
+			}
+		}
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <gsl/span>
+
+// Which OAM sprites are on each scanline, so sprite evaluation doesn't have to go through all 64 on every line. It's
+// only rebuilt when OAM or the sprite height changes.
+class NESSpriteIndex {
+public:
+	// Call whenever OAM is written
+	void invalidate();
+
+	bool isUpToDate(uint8_t height) const;
+	void update(gsl::span<const uint8_t> oam, uint8_t height);
+
+	// Bit n set for OAM sprite n
+	uint64_t getSprites(uint8_t scanline) const;
+
+	// More sprites than the 8 that fit in secondary OAM
+	bool hasOverflow(uint8_t scanline) const;
+
+private:
+	std::array<uint64_t, 256> sprites = {};
+	std::bitset<256> overflow;
+	uint8_t builtHeight = 0; // 0 when it needs rebuilding
+
+	void build(gsl::span<const uint8_t> oam, uint8_t height);
+	void buildScalar(gsl::span<const uint8_t> oam, uint8_t height);
+};
@@ -0,0 +1,60 @@
+#include "nes_tile_cache.h"
+#include "src/cpu/address_space.h"
+
+NESTileCache::Row NESTileCache::decodeRow(uint8_t low, uint8_t high, bool flipped)
+{
+	Row result;
+	for (size_t i = 0; i < 8; ++i) {
+		const size_t bit = flipped ? i : 7 - i;
+		result[i] = uint8_t(((low >> bit) & 1) | (((high >> bit) & 1) << 1));
+	}
+	return result;
+}
+
+void NESTileCache::update(const AddressSpace8BitBy16Bit& addressSpace, const TileSet& dirtyTiles)
+{
+	// Written tiles go first, while pages still point where they did when the writes happened. Every page showing
+	// the same memory has the same tile in it. Pages that have since been switched to different memory don't matter,
+	// as they get decoded all over again below.
+	if (dirtyTiles.any()) {
+		for (size_t tile = 0; tile < numTiles; ++tile) {
+			if (dirtyTiles[tile]) {
+				const uint8_t* data = pages[tile / tilesPerPage];
+				const size_t offset = (tile % tilesPerPage) * 16;
+				for (size_t page = 0; data && page < numPages; ++page) {
+					if (pages[page] == data) {
+						for (size_t row = 0; row < 8; ++row) {
+							decodePageRow(page, offset + row);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	for (size_t page = 0; page < numPages; ++page) {
+		const uint8_t* data = addressSpace.getPage(uint8_t(page));
+		if (data != pages[page]) {
+			pages[page] = data;
+			for (size_t offset = 0; offset < 256; offset += 16) {
+				for (size_t row = 0; row < 8; ++row) {
+					decodePageRow(page, offset + row);
+				}
+			}
+		}
+	}
+}
+
+void NESTileCache::decodePageRow(size_t page, size_t offset)
+{
+	// The offset is that of the row's low bitplane within the page
+	const size_t index = getRowIndex(uint16_t((page << 8) | offset));
+	const uint8_t* data = pages[page];
+	if (data) {
+		rows[index] = decodeRow(data[offset], data[offset + 8], false);
+		flippedRows[index] = decodeRow(data[offset], data[offset + 8], true);
+	} else {
+		rows[index] = {};
+		flippedRows[index] = {};
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include "../utils/macros.h"
+
+class AddressSpace8BitBy16Bit;
+
+// Pattern space ($0000-$1FFF) decoded to one byte per pixel (0-3), both as stored and horizontally flipped.
+// Pages are decoded again when they're pointed at a different CHR bank, and single tiles as they're written to.
+class NESTileCache {
+public:
+	using Row = std::array<uint8_t, 8>;
+	constexpr static size_t numTiles = 512;
+	using TileSet = std::bitset<numTiles>;
+
+	static Row decodeRow(uint8_t low, uint8_t high, bool flipped);
+
+	// Catches up with tiles written since the last update (which is only ever CHR-RAM) and with bank switches.
+	// Written tiles are taken to be in the memory their page pointed at as of the last update, so writing to a page
+	// whose isPageCurrent() is false needs an update first.
+	void update(const AddressSpace8BitBy16Bit& addressSpace, const TileSet& dirtyTiles);
+
+	FORCEINLINE bool isPageCurrent(uint8_t page, const uint8_t* data) const
+	{
+		return pages[page] == data;
+	}
+
+	// The address is that of the row's low bitplane, i.e. tile * 16 + row
+	FORCEINLINE const Row& getRow(uint16_t address) const
+	{
+		return rows[getRowIndex(address)];
+	}
+
+	FORCEINLINE const Row& getFlippedRow(uint16_t address) const
+	{
+		return flippedRows[getRowIndex(address)];
+	}
+
+private:
+	constexpr static size_t numPages = 32;
+	constexpr static size_t tilesPerPage = 16;
+
+	std::array<Row, numTiles * 8> rows = {};
+	std::array<Row, numTiles * 8> flippedRows = {};
+	std::array<const uint8_t*, numPages> pages = {}; // What each page was last decoded from
+
+	void decodePageRow(size_t page, size_t offset);
+
+	FORCEINLINE static size_t getRowIndex(uint16_t address)
+	{
+		return (size_t(address >> 4) << 3) | (address & 0x7);
+	}
+};
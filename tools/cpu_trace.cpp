@@ -0,0 +1,117 @@
+// Runs the 6502 core on its own and writes PC, P and the cycle count after every instruction, so that two builds of
+// the core (e.g. with and without EMUND_CPU_LAZY_FLAGS) can be checked against each other by comparing their output.
+//
+// Usage: cpu_trace <output file> [nestest.nes]
+// With a ROM, its PRG is mapped at $8000 and $C000 and run from $C000 (nestest's automated mode). Without one, memory
+// gets filled with random opcodes from a fixed set of seeds.
+
+#include "src/cpu/address_space.h"
+#include "src/cpu/cpu_6502.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+	constexpr int numRandomSeeds = 32;
+	constexpr int maxInstructions = 10000;
+	constexpr int nestestInstructions = 8991;
+
+	void traceRun(FILE* out, std::vector<uint8_t>& memory, int instructions)
+	{
+		AddressSpace8BitBy16Bit addressSpace;
+		addressSpace.map(memory, 0x0000, 0xFFFF);
+
+		CPU6502 cpu;
+		cpu.setAddressSpace(addressSpace);
+		cpu.raiseReset();
+
+		for (int i = 0; i < instructions && !cpu.hasError(); ++i) {
+			cpu.tick();
+			fprintf(out, "%04X %02X %llu\n", cpu.getPC(), cpu.getP(), static_cast<unsigned long long>(cpu.getCycle()));
+		}
+		fprintf(out, "error %d\n", static_cast<int>(cpu.getError()));
+
+		// Stores depend on A, X and Y, which the per-instruction lines leave out
+		uint64_t hash = 1469598103934665603ull;
+		for (const auto byte: memory) {
+			hash = (hash ^ byte) * 1099511628211ull;
+		}
+		fprintf(out, "memory %016llX\n", static_cast<unsigned long long>(hash));
+	}
+
+	bool traceNestest(FILE* out, const char* romPath)
+	{
+		FILE* rom = fopen(romPath, "rb");
+		if (!rom) {
+			return false;
+		}
+
+		uint8_t header[16];
+		std::vector<uint8_t> prg(16 * 1024);
+		const bool ok = fread(header, 1, 16, rom) == 16 && header[4] >= 1
+			&& fseek(rom, (header[6] & 0x04) ? 512 : 0, SEEK_CUR) == 0
+			&& fread(prg.data(), 1, prg.size(), rom) == prg.size();
+		fclose(rom);
+		if (!ok) {
+			return false;
+		}
+
+		std::vector<uint8_t> memory(65536);
+		std::copy(prg.begin(), prg.end(), memory.begin() + 0x8000);
+		std::copy(prg.begin(), prg.end(), memory.begin() + 0xC000);
+		memory[0xFFFC] = 0x00;
+		memory[0xFFFD] = 0xC0;
+		traceRun(out, memory, nestestInstructions);
+		return true;
+	}
+
+	void traceRandom(FILE* out)
+	{
+		std::vector<uint8_t> opcodes;
+		for (int opcode = 0; opcode < 256; ++opcode) {
+			if (CPU6502Opcodes::get(static_cast<uint8_t>(opcode)).operation != CPU6502Operation::Unknown) {
+				opcodes.push_back(static_cast<uint8_t>(opcode));
+			}
+		}
+
+		for (int seed = 0; seed < numRandomSeeds; ++seed) {
+			std::mt19937 rng(seed);
+			std::vector<uint8_t> memory(65536);
+			for (auto& byte: memory) {
+				// Mostly opcodes, with the occasional arbitrary byte so operands cover the whole range
+				byte = (rng() % 64 == 0) ? static_cast<uint8_t>(rng()) : opcodes[rng() % opcodes.size()];
+			}
+			fprintf(out, "seed %d\n", seed);
+			traceRun(out, memory, maxInstructions);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <output file> [nestest.nes]\n", argv[0]);
+		return 1;
+	}
+
+	FILE* out = fopen(argv[1], "w");
+	if (!out) {
+		fprintf(stderr, "Unable to open %s\n", argv[1]);
+		return 1;
+	}
+
+	int result = 0;
+	if (argc >= 3) {
+		if (!traceNestest(out, argv[2])) {
+			fprintf(stderr, "Unable to load %s\n", argv[2]);
+			result = 1;
+		}
+	} else {
+		traceRandom(out);
+	}
+
+	fclose(out);
+	return result;
+}
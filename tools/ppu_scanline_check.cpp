@@ -0,0 +1,261 @@
+// Checks the scanline renderer against the dot-by-dot one it stands in for. NESBackgroundLine::compose and
+// NESLineMixer::mix (with whatever SIMD this build has) are compared against their scalar versions on random lines,
+// and then two PPUs with the same random pattern, nametable, palette and OAM contents run whole frames, one through
+// tick() and the other through runUntil(). Their status, timing and address registers must match after every line,
+// as must what $2002 reads partway through lines return, and their frame buffers after every frame. Some register
+// writes land partway through lines, so the dot renderer's fallback for those gets checked too.
+//
+// Usage: ppu_scanline_check
+// Returns 0 if everything matched.
+
+#include "src/cpu/address_space.h"
+#include "src/nes/nes_background_line.h"
+#include "src/nes/nes_line_mixer.h"
+#include "src/nes/nes_ppu.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+	constexpr int numComposeRuns = 100000;
+	constexpr int numMixRuns = 100000;
+	constexpr int numFrameSeeds = 64;
+	constexpr int framesPerSeed = 3;
+	constexpr uint64_t cyclesPerLine = 341;
+	constexpr uint64_t linesPerFrame = 262;
+	constexpr uint64_t cyclesPerFrame = cyclesPerLine * linesPerFrame;
+
+	int checkCompose()
+	{
+		std::mt19937 rng(0);
+		std::vector<NESTileCache::Row> rows(64);
+		int failures = 0;
+
+		for (int run = 0; run < numComposeRuns; ++run) {
+			// Every other run, rows carry palette bits of their own, as they do for tiles whose palette changes midway
+			for (auto& row: rows) {
+				for (auto& pixel: row) {
+					pixel = static_cast<uint8_t>(rng() & ((run & 1) ? 0xF : 0x3));
+				}
+			}
+
+			NESBackgroundLine::Tiles tiles;
+			NESBackgroundLine::Palettes palettes;
+			for (size_t i = 0; i < NESBackgroundLine::numTiles; ++i) {
+				tiles[i] = &rows[rng() % rows.size()];
+				palettes[i] = static_cast<uint8_t>(rng() & 3);
+			}
+			const uint8_t fineX = static_cast<uint8_t>(rng() & 7);
+			const size_t start = (rng() & 1) ? 8 : 0;
+
+			NESBackgroundLine::Pixels composed;
+			NESBackgroundLine::Pixels reference;
+			composed.fill(0xAA);
+			reference.fill(0x55);
+			NESBackgroundLine::compose(tiles, palettes, fineX, start, composed);
+			NESBackgroundLine::composeScalar(tiles, palettes, fineX, start, reference);
+
+			if (composed != reference) {
+				if (failures++ < 10) {
+					fprintf(stderr, "compose differs from composeScalar on run %d (fine x %d, start %d)\n", run, fineX, int(start));
+				}
+			}
+		}
+		return failures;
+	}
+
+	int checkMix()
+	{
+		std::mt19937 rng(1);
+		int failures = 0;
+
+		for (int run = 0; run < numMixRuns; ++run) {
+			// From no sprites at all to sprites everywhere
+			const uint32_t spriteDensity = rng() % 5;
+			NESLineMixer::Pixels background;
+			NESLineMixer::Pixels sprites;
+			for (size_t i = 0; i < background.size(); ++i) {
+				background[i] = static_cast<uint8_t>(rng() & 0xF);
+				sprites[i] = rng() % 4 < spriteDensity ? static_cast<uint8_t>(rng() & (0xF | NESLineMixer::spriteBehindBackground)) : 0;
+			}
+
+			// Every other run, sprite 0 covers 8 pixels somewhere, possibly partly off the right edge
+			if (run & 1) {
+				const size_t spriteZeroX = rng() % background.size();
+				for (size_t i = spriteZeroX; i < std::min(spriteZeroX + 8, background.size()); ++i) {
+					sprites[i] = static_cast<uint8_t>((rng() & (0xF | NESLineMixer::spriteBehindBackground)) | NESLineMixer::spriteZero);
+				}
+			}
+
+			NESLineMixer::Pixels mixed;
+			NESLineMixer::Pixels reference;
+			mixed.fill(0xAA);
+			reference.fill(0x55);
+			const int hit = NESLineMixer::mix(background, sprites, mixed);
+			const int referenceHit = NESLineMixer::mixScalar(background, sprites, reference);
+
+			if (hit != referenceHit || mixed != reference) {
+				if (failures++ < 10) {
+					fprintf(stderr, "mix differs from mixScalar on run %d (sprite 0 hit at %d vs %d)\n", run, hit, referenceHit);
+				}
+			}
+		}
+		return failures;
+	}
+
+	void writeBoth(NESPPU& a, NESPPU& b, uint16_t address, uint8_t value)
+	{
+		a.writeRegister(address, value);
+		b.writeRegister(address, value);
+	}
+
+	// The dot PPU ticks its way there, and the other gets there however runUntil sees fit
+	void runBoth(NESPPU& dotPPU, NESPPU& linePPU, uint64_t cycle)
+	{
+		while (dotPPU.getCycle() < cycle) {
+			dotPPU.tick();
+		}
+		while (linePPU.getCycle() < cycle) {
+			linePPU.runUntil(cycle);
+		}
+	}
+
+	bool isSameState(const NESPPU& a, const NESPPU& b)
+	{
+		return a.getCycle() == b.getCycle()
+			&& a.getX() == b.getX()
+			&& a.getY() == b.getY()
+			&& a.getStatus() == b.getStatus()
+			&& a.getStatusChangeCycle() == b.getStatusChangeCycle()
+			&& a.getNextStatusChangeCycle() == b.getNextStatusChangeCycle()
+			&& a.getVRAMAddress() == b.getVRAMAddress()
+			&& a.getOAMAddress() == b.getOAMAddress();
+	}
+
+	int checkFrames(int seed)
+	{
+		std::mt19937 rng(seed);
+
+		// Pattern tables and nametables, with palette RAM behind the PPU's own registers
+		std::vector<uint8_t> memory(0x4000);
+		for (auto& byte: memory) {
+			byte = static_cast<uint8_t>(rng());
+		}
+		AddressSpace8BitBy16Bit addressSpace;
+		addressSpace.map(memory, 0x0000, 0x3FFF);
+
+		std::vector<uint32_t> dotFrame(256 * 240);
+		std::vector<uint32_t> lineFrame(256 * 240);
+		// A copy, as not everything in a new PPU is initialised, and both have to start out the same
+		NESPPU dotPPU;
+		dotPPU.setAddressSpace(addressSpace);
+		NESPPU linePPU = dotPPU;
+		dotPPU.setFrameBuffer(dotFrame);
+		linePPU.setFrameBuffer(lineFrame);
+
+		// Registers are ignored for a while after power-on
+		while (dotPPU.getCycle() < 2 * cyclesPerFrame) {
+			dotPPU.tick();
+			linePPU.tick();
+		}
+
+		auto dotOAM = dotPPU.getOAMData();
+		auto lineOAM = linePPU.getOAMData();
+		for (size_t i = 0; i < dotOAM.size(); ++i) {
+			dotOAM[i] = lineOAM[i] = static_cast<uint8_t>(rng());
+		}
+
+		writeBoth(dotPPU, linePPU, 0x2006, 0x3F);
+		writeBoth(dotPPU, linePPU, 0x2006, 0x00);
+		for (int i = 0; i < 32; ++i) {
+			writeBoth(dotPPU, linePPU, 0x2007, static_cast<uint8_t>(rng() & 0x3F));
+		}
+
+		writeBoth(dotPPU, linePPU, 0x2000, static_cast<uint8_t>(rng() & 0x3B));
+		writeBoth(dotPPU, linePPU, 0x2005, static_cast<uint8_t>(rng()));
+		writeBoth(dotPPU, linePPU, 0x2005, static_cast<uint8_t>(rng()));
+		writeBoth(dotPPU, linePPU, 0x2001, static_cast<uint8_t>(rng() | 0x08));
+
+		for (int frame = 0; frame < framesPerSeed; ++frame) {
+			// Sprite 0 somewhere on screen, over a background that's more often opaque than not, with both showing
+			dotOAM = dotPPU.getOAMData();
+			lineOAM = linePPU.getOAMData();
+			dotOAM[0] = lineOAM[0] = static_cast<uint8_t>(rng() % 239);
+			dotOAM[3] = lineOAM[3] = static_cast<uint8_t>(rng());
+			writeBoth(dotPPU, linePPU, 0x2001, static_cast<uint8_t>((rng() & 0xE6) | 0x18));
+
+			for (uint64_t line = 0; line < linesPerFrame; ++line) {
+				// Odd frames skip a dot, so go by where the line actually ends rather than counting cycles
+				const uint64_t lineEnd = dotPPU.getCycle() + cyclesPerLine - dotPPU.getX();
+				const int y = int(dotPPU.getY());
+
+				// Now and then something lands partway through the line, which leaves the rest of it to tick()
+				if (rng() % 8 == 0) {
+					runBoth(dotPPU, linePPU, dotPPU.getCycle() + rng() % (lineEnd - dotPPU.getCycle()));
+					switch (rng() % 4) {
+					case 0:
+						writeBoth(dotPPU, linePPU, 0x2001, static_cast<uint8_t>(rng()));
+						break;
+					case 1:
+						writeBoth(dotPPU, linePPU, 0x2005, static_cast<uint8_t>(rng()));
+						break;
+					case 2:
+						writeBoth(dotPPU, linePPU, 0x2006, static_cast<uint8_t>(rng()));
+						writeBoth(dotPPU, linePPU, 0x2006, static_cast<uint8_t>(rng()));
+						break;
+					case 3:
+						{
+							// Catches sprite 0 hits and overflow flagged at the wrong dot
+							const uint8_t dotStatus = dotPPU.readRegister(0x2002);
+							const uint8_t lineStatus = linePPU.readRegister(0x2002);
+							if (dotStatus != lineStatus) {
+								fprintf(stderr, "$2002 reads %02X instead of %02X on line %d of frame %d of seed %d\n", lineStatus, dotStatus, y, frame, seed);
+								return 1;
+							}
+						}
+						break;
+					}
+				}
+
+				runBoth(dotPPU, linePPU, lineEnd);
+				if (!isSameState(dotPPU, linePPU)) {
+					fprintf(stderr, "Scanline renderer state differs from the dot renderer's after line %d of frame %d of seed %d\n", y, frame, seed);
+					return 1;
+				}
+
+				// Now and then change the mask or scroll in between lines, which the scanline renderer has to pick up
+				if (rng() % 16 == 0) {
+					writeBoth(dotPPU, linePPU, 0x2001, static_cast<uint8_t>(rng()));
+				}
+				if (rng() % 32 == 0) {
+					writeBoth(dotPPU, linePPU, 0x2005, static_cast<uint8_t>(rng()));
+				}
+			}
+
+			if (dotFrame != lineFrame) {
+				fprintf(stderr, "Scanline renderer differs from the dot renderer on frame %d of seed %d\n", frame, seed);
+				return 1;
+			}
+		}
+		return 0;
+	}
+}
+
+int main()
+{
+	const int composeFailures = checkCompose();
+	printf("compose vs composeScalar: %d of %d runs differ\n", composeFailures, numComposeRuns);
+
+	const int mixFailures = checkMix();
+	printf("mix vs mixScalar: %d of %d runs differ\n", mixFailures, numMixRuns);
+
+	int frameFailures = 0;
+	for (int seed = 0; seed < numFrameSeeds; ++seed) {
+		frameFailures += checkFrames(seed);
+	}
+	printf("Scanline vs dot renderer: %d of %d seeds differ\n", frameFailures, numFrameSeeds);
+
+	return composeFailures == 0 && mixFailures == 0 && frameFailures == 0 ? 0 : 1;
+}